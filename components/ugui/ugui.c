@@ -4579,13 +4579,16 @@ UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y
    g->desktop_color = 0x5E8BEf;
    #endif
    #ifdef USE_COLOR_RGB565
-   g->desktop_color = 0x5C5D;
+   g->desktop_color = UG_RGB565(0x5C5D);
    #endif
    g->fore_color = C_WHITE;
    g->back_color = C_BLACK;
    g->next_window = NULL;
    g->active_window = NULL;
    g->last_window = NULL;
+   #ifdef USE_SURFACES
+   g->surface = NULL;
+   #endif
 
    /* Clear drivers */
    for(i=0;i<NUMBER_OF_DRIVERS;i++)
@@ -4595,6 +4598,11 @@ UG_S16 UG_Init( UG_GUI* g, void (*p)(UG_S16,UG_S16,UG_COLOR), UG_S16 x, UG_S16 y
    }
 
    gui = g;
+
+   #ifdef USE_GLYPH_CACHE
+   UG_GlyphCacheClear();
+   #endif
+
    return 1;
 }
 
@@ -4650,6 +4658,86 @@ void UG_FillFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
    }
 }
 
+#define SPAN_MIN_LENGTH                               4
+
+/* Draw a run of pixels in one row (y1 == y2) or one column (x1 == x2), with
+   x1 <= x2 and y1 <= y2. The fill driver stores a row in one go and a column
+   with a stride, instead of a pset per pixel. */
+static void _UG_DrawSpan( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_S16 n;
+
+   /* Is hardware acceleration available? Very short spans, as on the
+      round parts of circles, cost less through pset. */
+   if ( (x2 - x1) + (y2 - y1) >= SPAN_MIN_LENGTH - 1 && (gui->driver[DRIVER_FILL_FRAME].state & DRIVER_ENABLED) )
+   {
+      if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))gui->driver[DRIVER_FILL_FRAME].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
+   }
+
+   if ( y1 == y2 )
+   {
+      for( n=x1; n<=x2; n++ ) gui->pset(n,y1,c);
+   }
+   else
+   {
+      for( n=y1; n<=y2; n++ ) gui->pset(x1,n,c);
+   }
+}
+
+/* The octants of a circle as spans. Bits of s select the octants, as for
+   UG_DrawArc. While x stays the same, the points (x, y) make a column and
+   the points (y, x) a row, so each run of steps is drawn as one span per
+   octant. */
+static void _UG_DrawArcSpans( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
+{
+   UG_S16 x,y,xd,yd,e,px,py,ys;
+
+   xd = 1 - (r << 1);
+   yd = 0;
+   e = 0;
+   x = r;
+   y = 0;
+   ys = 0;
+
+   while ( x >= y )
+   {
+      px = x;
+      py = y;
+
+      y++;
+      e += yd;
+      yd += 2;
+      if ( ((e << 1) + xd) > 0 )
+      {
+         x--;
+         e += xd;
+         xd += 2;
+      }
+
+      /* Steps ys to py all had x == px */
+      if ( x != px || x < y )
+      {
+         // Q1
+         if ( s & 0x01 ) _UG_DrawSpan(x0 + px, y0 - py, x0 + px, y0 - ys, c);
+         if ( s & 0x02 ) _UG_DrawSpan(x0 + ys, y0 - px, x0 + py, y0 - px, c);
+
+         // Q2
+         if ( s & 0x04 ) _UG_DrawSpan(x0 - py, y0 - px, x0 - ys, y0 - px, c);
+         if ( s & 0x08 ) _UG_DrawSpan(x0 - px, y0 - py, x0 - px, y0 - ys, c);
+
+         // Q3
+         if ( s & 0x10 ) _UG_DrawSpan(x0 - px, y0 + ys, x0 - px, y0 + py, c);
+         if ( s & 0x20 ) _UG_DrawSpan(x0 - py, y0 + px, x0 - ys, y0 + px, c);
+
+         // Q4
+         if ( s & 0x40 ) _UG_DrawSpan(x0 + ys, y0 + px, x0 + py, y0 + px, c);
+         if ( s & 0x80 ) _UG_DrawSpan(x0 + px, y0 + ys, x0 + px, y0 + py, c);
+
+         ys = y;
+      }
+   }
+}
+
 void UG_FillRoundFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_S16 r, UG_COLOR c )
 {
    UG_S16  x,y,xd;
@@ -4841,39 +4929,11 @@ void UG_DrawPixel( UG_S16 x0, UG_S16 y0, UG_COLOR c )
 
 void UG_DrawCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
 {
-   UG_S16 x,y,xd,yd,e;
-
    if ( x0<0 ) return;
    if ( y0<0 ) return;
    if ( r<=0 ) return;
 
-   xd = 1 - (r << 1);
-   yd = 0;
-   e = 0;
-   x = r;
-   y = 0;
-
-   while ( x >= y )
-   {
-      gui->pset(x0 - x, y0 + y, c);
-      gui->pset(x0 - x, y0 - y, c);
-      gui->pset(x0 + x, y0 + y, c);
-      gui->pset(x0 + x, y0 - y, c);
-      gui->pset(x0 - y, y0 + x, c);
-      gui->pset(x0 - y, y0 - x, c);
-      gui->pset(x0 + y, y0 + x, c);
-      gui->pset(x0 + y, y0 - x, c);
-
-      y++;
-      e += yd;
-      yd += 2;
-      if ( ((e << 1) + xd) > 0 )
-      {
-         x--;
-         e += xd;
-         xd += 2;
-      }
-   }
+   _UG_DrawArcSpans(x0, y0, r, 0xFF, c);
 }
 
 void UG_FillCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
@@ -4916,51 +4976,16 @@ void UG_FillCircle( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_COLOR c )
 
 void UG_DrawArc( UG_S16 x0, UG_S16 y0, UG_S16 r, UG_U8 s, UG_COLOR c )
 {
-   UG_S16 x,y,xd,yd,e;
-
    if ( x0<0 ) return;
    if ( y0<0 ) return;
    if ( r<=0 ) return;
 
-   xd = 1 - (r << 1);
-   yd = 0;
-   e = 0;
-   x = r;
-   y = 0;
-
-   while ( x >= y )
-   {
-      // Q1
-      if ( s & 0x01 ) gui->pset(x0 + x, y0 - y, c);
-      if ( s & 0x02 ) gui->pset(x0 + y, y0 - x, c);
-
-      // Q2
-      if ( s & 0x04 ) gui->pset(x0 - y, y0 - x, c);
-      if ( s & 0x08 ) gui->pset(x0 - x, y0 - y, c);
-
-      // Q3
-      if ( s & 0x10 ) gui->pset(x0 - x, y0 + y, c);
-      if ( s & 0x20 ) gui->pset(x0 - y, y0 + x, c);
-
-      // Q4
-      if ( s & 0x40 ) gui->pset(x0 + y, y0 + x, c);
-      if ( s & 0x80 ) gui->pset(x0 + x, y0 + y, c);
-
-      y++;
-      e += yd;
-      yd += 2;
-      if ( ((e << 1) + xd) > 0 )
-      {
-         x--;
-         e += xd;
-         xd += 2;
-      }
-   }
+   _UG_DrawArcSpans(x0, y0, r, s, c);
 }
 
 void UG_DrawLine( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
 {
-   UG_S16 n, dx, dy, sgndx, sgndy, dxabs, dyabs, x, y, drawx, drawy;
+   UG_S16 n, dx, dy, sgndx, sgndy, dxabs, dyabs, x, y, drawx, drawy, start;
 
    /* Is hardware acceleration available? */
    if ( gui->driver[DRIVER_DRAW_LINE].state & DRIVER_ENABLED )
@@ -4968,6 +4993,20 @@ void UG_DrawLine( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
       if( ((UG_RESULT(*)(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c))gui->driver[DRIVER_DRAW_LINE].driver)(x1,y1,x2,y2,c) == UG_RESULT_OK ) return;
    }
 
+   /* Rows and columns are a single span */
+   if ( y1 == y2 )
+   {
+      if ( x1 <= x2 ) _UG_DrawSpan(x1,y1,x2,y1,c);
+      else _UG_DrawSpan(x2,y1,x1,y1,c);
+      return;
+   }
+   if ( x1 == x2 )
+   {
+      if ( y1 <= y2 ) _UG_DrawSpan(x1,y1,x1,y2,c);
+      else _UG_DrawSpan(x1,y2,x1,y1,c);
+      return;
+   }
+
    dx = x2 - x1;
    dy = y2 - y1;
    dxabs = (dx>0)?dx:-dx;
@@ -4979,36 +5018,46 @@ void UG_DrawLine( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
    drawx = x1;
    drawy = y1;
 
-   gui->pset(drawx, drawy,c);
-
+   /* Other lines are drawn as the runs of pixels that share a row, or a
+      column for steep lines */
    if( dxabs >= dyabs )
    {
+      start = drawx;
       for( n=0; n<dxabs; n++ )
       {
          y += dyabs;
          if( y >= dxabs )
          {
             y -= dxabs;
+            if ( sgndx > 0 ) _UG_DrawSpan(start,drawy,drawx,drawy,c);
+            else _UG_DrawSpan(drawx,drawy,start,drawy,c);
             drawy += sgndy;
+            start = drawx + sgndx;
          }
          drawx += sgndx;
-         gui->pset(drawx, drawy,c);
       }
+      if ( sgndx > 0 ) _UG_DrawSpan(start,drawy,drawx,drawy,c);
+      else _UG_DrawSpan(drawx,drawy,start,drawy,c);
    }
    else
    {
+      start = drawy;
       for( n=0; n<dyabs; n++ )
       {
          x += dxabs;
          if( x >= dyabs )
          {
             x -= dyabs;
+            if ( sgndy > 0 ) _UG_DrawSpan(drawx,start,drawx,drawy,c);
+            else _UG_DrawSpan(drawx,drawy,drawx,start,c);
             drawx += sgndx;
+            start = drawy + sgndy;
          }
          drawy += sgndy;
-         gui->pset(drawx, drawy,c);
       }
-   }  
+      if ( sgndy > 0 ) _UG_DrawSpan(drawx,start,drawx,drawy,c);
+      else _UG_DrawSpan(drawx,drawy,drawx,start,c);
+   }
 }
 
 void UG_PutString( UG_S16 x, UG_S16 y, char* str )
@@ -5242,20 +5291,20 @@ const UG_COLOR pal_checkbox_released[] =
 #ifdef USE_COLOR_RGB565
 const UG_COLOR pal_window[] =
 {
-   0x632C,
-   0x632C,
-   0x632C,
-   0x632C,
+   UG_RGB565(0x632C),
+   UG_RGB565(0x632C),
+   UG_RGB565(0x632C),
+   UG_RGB565(0x632C),
 
-   0xFFFF,
-   0xFFFF,
-   0x6B4D,
-   0x6B4D,
+   UG_RGB565(0xFFFF),
+   UG_RGB565(0xFFFF),
+   UG_RGB565(0x6B4D),
+   UG_RGB565(0x6B4D),
 
-   0xE71C,
-   0xE71C,
-   0x9D13,
-   0x9D13,
+   UG_RGB565(0xE71C),
+   UG_RGB565(0xE71C),
+   UG_RGB565(0x9D13),
+   UG_RGB565(0x9D13),
 };
 
 const UG_COLOR pal_button_pressed[] =
@@ -5336,12 +5385,231 @@ const UG_COLOR pal_checkbox_released[] =
 /* -------------------------------------------------------------------------------- */
 /* -- INTERNAL FUNCTIONS                                                         -- */
 /* -------------------------------------------------------------------------------- */
+/* -------------------------------------------------------------------------------- */
+/* -- 8 BPP FONT BLENDING                                                        -- */
+/* -------------------------------------------------------------------------------- */
+/* Widest 8 bpp glyph that is blended into a row and blitted */
+#define BLEND_ROW_MAX                                 64
+
+#ifdef USE_COLOR_RGB565
+/* Colors for 32 coverage levels between the back and the fore color,
+   blended on the 5-6-5 channels */
+#define BLEND_LEVELS                                  32
+
+static UG_COLOR blend_table[BLEND_LEVELS];
+static UG_COLOR blend_fc;
+static UG_COLOR blend_bc;
+static UG_U8 blend_valid = 0;
+
+static void _UG_BlendBegin( UG_COLOR fc, UG_COLOR bc )
+{
+   UG_U16 f,b,l,a;
+   UG_U16 r,g,bl;
+
+   if ( blend_valid && fc == blend_fc && bc == blend_bc ) return;
+
+   /* UG_RGB565 swaps back from panel byte order, if that is in use */
+   f = UG_RGB565(fc);
+   b = UG_RGB565(bc);
+
+   for( l=0;l<BLEND_LEVELS;l++ )
+   {
+      a = l * 255 / (BLEND_LEVELS - 1);
+      r  = ((f >> 11)         * a + (b >> 11)         * (255 - a) + 127) / 255;
+      g  = (((f >> 5) & 0x3F) * a + ((b >> 5) & 0x3F) * (255 - a) + 127) / 255;
+      bl = ((f & 0x1F)        * a + (b & 0x1F)        * (255 - a) + 127) / 255;
+      blend_table[l] = UG_RGB565((r << 11) | (g << 5) | bl);
+   }
+
+   blend_fc = fc;
+   blend_bc = bc;
+   blend_valid = 1;
+}
+
+static inline UG_COLOR _UG_Blend( UG_U8 b )
+{
+   return blend_table[b >> 3];
+}
+#else
+static UG_COLOR blend_fc;
+static UG_COLOR blend_bc;
+
+static void _UG_BlendBegin( UG_COLOR fc, UG_COLOR bc )
+{
+   blend_fc = fc;
+   blend_bc = bc;
+}
+
+static inline UG_COLOR _UG_Blend( UG_U8 b )
+{
+   return ((((blend_fc & 0x0000FF) * b + (blend_bc & 0x0000FF) * (256 - b)) >> 8) & 0x0000FF) |//Blue component
+          ((((blend_fc & 0x00FF00) * b + (blend_bc & 0x00FF00) * (256 - b)) >> 8) & 0x00FF00) |//Green component
+          ((((blend_fc & 0xFF0000) * b + (blend_bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
+}
+#endif
+
+#ifdef USE_GLYPH_CACHE
+/* -------------------------------------------------------------------------------- */
+/* -- GLYPH CACHE                                                                -- */
+/* -------------------------------------------------------------------------------- */
+#define GLYPH_CACHE_BUCKETS                           64
+#define GLYPH_NONE                                    -1
+
+typedef struct
+{
+   const unsigned char* p;    /* font data: gui->font is a copy, so not the font */
+   UG_COLOR fc;
+   UG_COLOR bc;
+   UG_U8 chr;
+   UG_U8 width;
+   UG_U8 height;
+   UG_S16 next;               /* next entry in the same bucket */
+   UG_U32 used;               /* last use, for LRU eviction */
+   UG_COLOR pixels[GLYPH_CACHE_MAX_PIXELS];
+} UG_GLYPH;
+
+static UG_GLYPH glyph_cache[GLYPH_CACHE_ENTRIES];
+static UG_S16 glyph_bucket[GLYPH_CACHE_BUCKETS];
+static UG_U16 glyph_count;
+static UG_U32 glyph_tick;
+
+void UG_GlyphCacheClear( void )
+{
+   UG_U16 i;
+
+   for( i=0;i<GLYPH_CACHE_BUCKETS;i++ ) glyph_bucket[i] = GLYPH_NONE;
+   glyph_count = 0;
+   glyph_tick = 0;
+}
+
+static UG_U16 _UG_GlyphHash( const unsigned char* p, UG_U8 chr, UG_COLOR fc, UG_COLOR bc )
+{
+   UG_U32 h = (UG_U32)(uintptr_t)p ^ chr ^ ((UG_U32)fc * 31) ^ ((UG_U32)bc * 131);
+   h ^= h >> 7;
+   return (h ^ (h >> 13)) % GLYPH_CACHE_BUCKETS;
+}
+
+/* Take a free entry, or the least recently used one out of its bucket */
+static UG_GLYPH* _UG_GlyphAlloc( void )
+{
+   UG_U16 i,victim;
+   UG_S16* link;
+
+   if ( glyph_count < GLYPH_CACHE_ENTRIES ) return &glyph_cache[glyph_count++];
+
+   victim = 0;
+   for( i=1;i<GLYPH_CACHE_ENTRIES;i++ )
+   {
+      if ( glyph_cache[i].used < glyph_cache[victim].used ) victim = i;
+   }
+
+   link = &glyph_bucket[_UG_GlyphHash(glyph_cache[victim].p,glyph_cache[victim].chr,glyph_cache[victim].fc,glyph_cache[victim].bc)];
+   while ( *link != victim ) link = &glyph_cache[*link].next;
+   *link = glyph_cache[victim].next;
+
+   return &glyph_cache[victim];
+}
+
+/* Expand a character the way _UG_PutChar draws it */
+static void _UG_GlyphExpand( UG_GLYPH* g, UG_U8 bt, const UG_FONT* font, UG_U16 bn )
+{
+   UG_U16 i,j,k,c;
+   UG_U8 b;
+   UG_U32 index;
+   UG_COLOR* dst = g->pixels;
+
+   if (font->font_type == FONT_TYPE_1BPP)
+   {
+      index = (bt - font->start_char)* font->char_height * bn;
+      for( j=0;j<g->height;j++ )
+      {
+         c=g->width;
+         for( i=0;i<bn;i++ )
+         {
+            b = font->p[index++];
+            for( k=0;(k<8) && c;k++ )
+            {
+               *dst++ = ( b & 0x01 ) ? g->fc : g->bc;
+               b >>= 1;
+               c--;
+            }
+         }
+      }
+   }
+   else if (font->font_type == FONT_TYPE_8BPP)
+   {
+      _UG_BlendBegin(g->fc,g->bc);
+      index = (bt - font->start_char)* font->char_height * font->char_width;
+      for( j=0;j<g->height;j++ )
+      {
+         for( i=0;i<g->width;i++ )
+         {
+            *dst++ = _UG_Blend(font->p[index++]);
+         }
+         index += font->char_width - g->width;
+      }
+   }
+}
+
+/* Draw a character out of the cache. Returns 0 if it is too large to cache. */
+static UG_U8 _UG_PutCachedChar( UG_U8 bt, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font, UG_U16 bn, UG_U16 actual_char_width )
+{
+   UG_U16 h,i,j;
+   UG_S16 n;
+   UG_GLYPH* g;
+   const UG_COLOR* src;
+
+   if ( actual_char_width * font->char_height > GLYPH_CACHE_MAX_PIXELS ) return 0;
+
+   h = _UG_GlyphHash(font->p,bt,fc,bc);
+   for( n=glyph_bucket[h];n!=GLYPH_NONE;n=glyph_cache[n].next )
+   {
+      g = &glyph_cache[n];
+      if ( g->p == font->p && g->chr == bt && g->fc == fc && g->bc == bc &&
+           g->width == actual_char_width && g->height == font->char_height ) break;
+   }
+
+   if ( n == GLYPH_NONE )
+   {
+      g = _UG_GlyphAlloc();
+      g->p = font->p;
+      g->chr = bt;
+      g->fc = fc;
+      g->bc = bc;
+      g->width = actual_char_width;
+      g->height = font->char_height;
+      _UG_GlyphExpand(g,bt,font,bn);
+
+      g->next = glyph_bucket[h];
+      glyph_bucket[h] = g - glyph_cache;
+   }
+
+   g->used = ++glyph_tick;
+
+   /* Is hardware acceleration available? */
+   if ( gui->driver[DRIVER_BLIT].state & DRIVER_ENABLED )
+   {
+      if( ((UG_RESULT(*)(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p))gui->driver[DRIVER_BLIT].driver)(x,y,g->width,g->height,g->width,g->pixels) == UG_RESULT_OK ) return 1;
+   }
+
+   src = g->pixels;
+   for( j=0;j<g->height;j++ )
+   {
+      for( i=0;i<g->width;i++ )
+      {
+         gui->pset(x+i,y+j,*src++);
+      }
+   }
+
+   return 1;
+}
+#endif
+
 void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const UG_FONT* font)
 {
    UG_U16 i,j,k,xo,yo,c,bn,actual_char_width;
    UG_U8 b,bt;
    UG_U32 index;
-   UG_COLOR color;
    void(*push_pixel)(UG_COLOR);
 
    bt = (UG_U8)chr;
@@ -5367,6 +5635,33 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
    if ( font->char_width % 8 ) bn++;
    actual_char_width = (font->widths ? font->widths[bt - font->start_char] : font->char_width);
 
+   #ifdef USE_GLYPH_CACHE
+   if ( _UG_PutCachedChar(bt,x,y,fc,bc,font,bn,actual_char_width) ) return;
+   #endif
+
+   /* Blend 8 bpp glyphs a row at a time and blit the rows */
+   if ( (font->font_type == FONT_TYPE_8BPP) && (actual_char_width <= BLEND_ROW_MAX) && (gui->driver[DRIVER_BLIT].state & DRIVER_ENABLED) )
+   {
+      UG_COLOR row[BLEND_ROW_MAX];
+
+      _UG_BlendBegin(fc,bc);
+      index = (bt - font->start_char)* font->char_height * font->char_width;
+      for( j=0;j<font->char_height;j++ )
+      {
+         for( i=0;i<actual_char_width;i++ )
+         {
+            row[i] = _UG_Blend(font->p[index++]);
+         }
+         index += font->char_width - actual_char_width;
+         if( ((UG_RESULT(*)(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p))gui->driver[DRIVER_BLIT].driver)(x,y+j,actual_char_width,1,actual_char_width,row) != UG_RESULT_OK )
+         {
+            /* Leave the glyph to the paths below */
+            break;
+         }
+      }
+      if ( j == font->char_height ) return;
+   }
+
    /* Is hardware acceleration available? */
    if ( gui->driver[DRIVER_FILL_AREA].state & DRIVER_ENABLED )
    {
@@ -5400,16 +5695,13 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
 	  }
 	  else if (font->font_type == FONT_TYPE_8BPP)
 	  {
+		   _UG_BlendBegin(fc,bc);
 		   index = (bt - font->start_char)* font->char_height * font->char_width;
 		   for( j=0;j<font->char_height;j++ )
 		   {
 			  for( i=0;i<actual_char_width;i++ )
 			  {
-				 b = font->p[index++];
-				 color = ((((fc & 0x0000FF) * b + (bc & 0x0000FF) * (256 - b)) >> 8) & 0x0000FF) |//Blue component
-				         ((((fc & 0x00FF00) * b + (bc & 0x00FF00) * (256 - b)) >> 8) & 0x00FF00) |//Green component
-				         ((((fc & 0xFF0000) * b + (bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
-				 push_pixel(color);
+				 push_pixel(_UG_Blend(font->p[index++]));
 			  }
 			  index += font->char_width - actual_char_width;
 		  }
@@ -5448,17 +5740,14 @@ void _UG_PutChar( char chr, UG_S16 x, UG_S16 y, UG_COLOR fc, UG_COLOR bc, const
       }
       else if (font->font_type == FONT_TYPE_8BPP)
       {
+         _UG_BlendBegin(fc,bc);
          index = (bt - font->start_char)* font->char_height * font->char_width;
          for( j=0;j<font->char_height;j++ )
          {
             xo = x;
             for( i=0;i<actual_char_width;i++ )
             {
-               b = font->p[index++];
-               color = ((((fc & 0x0000FF) * b + (bc & 0x0000FF) * (256 - b)) >> 8) & 0x0000FF) |//Blue component
-                       ((((fc & 0x00FF00) * b + (bc & 0x00FF00) * (256 - b)) >> 8) & 0x00FF00) |//Green component
-                       ((((fc & 0xFF0000) * b + (bc & 0xFF0000) * (256 - b)) >> 8) & 0xFF0000); //Red component
-               gui->pset(xo,yo,color);
+               gui->pset(xo,yo,_UG_Blend(font->p[index++]));
                xo++;
             }
             index += font->char_width - actual_char_width;
@@ -5885,6 +6174,235 @@ void UG_WaitForUpdate( void )
    #endif    
 }
 
+#ifdef USE_COLOR_RGB565
+/* Copy a block of pixels, clipped to the screen. With DRIVER_BLIT_SWAP the
+   pixels are byte swapped from UG_COLOR and get converted on the way. */
+static void _UG_BlitRGB565( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_U16* data, UG_U8 type )
+{
+   UG_S16 i,j,xs,ys,xe,ye;
+   UG_COLOR c;
+
+   xs = ( x < 0 ) ? 0 : x;
+   ys = ( y < 0 ) ? 0 : y;
+   xe = ( x+w-1 > gui->x_dim-1 ) ? gui->x_dim-1 : x+w-1;
+   ye = ( y+h-1 > gui->y_dim-1 ) ? gui->y_dim-1 : y+h-1;
+   if ( xs > xe || ys > ye ) return;
+
+   data += (ys-y)*stride + (xs-x);
+
+   /* Is hardware acceleration available? */
+   if ( gui->driver[type].state & DRIVER_ENABLED )
+   {
+      if( ((UG_RESULT(*)(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p))gui->driver[type].driver)(xs,ys,xe-xs+1,ye-ys+1,stride,data) == UG_RESULT_OK ) return;
+   }
+
+   for( j=0;j<=ye-ys;j++ )
+   {
+      for( i=0;i<=xe-xs;i++ )
+      {
+         c = data[j*stride+i];
+         if ( type == DRIVER_BLIT_SWAP ) c = (UG_COLOR)((c << 8) | (c >> 8));
+         gui->pset(xs+i,ys+j,c);
+      }
+   }
+}
+
+void UG_BlitRGB565( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_U16* data )
+{
+   _UG_BlitRGB565(x,y,w,h,stride,data,DRIVER_BLIT);
+}
+
+void UG_BlitRGB565Swap( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_U16* data )
+{
+   _UG_BlitRGB565(x,y,w,h,stride,data,DRIVER_BLIT_SWAP);
+}
+
+#ifdef USE_SURFACES
+/* -------------------------------------------------------------------------------- */
+/* -- SURFACES                                                                   -- */
+/* -------------------------------------------------------------------------------- */
+/* The pset and drivers of a GUI made by UG_SurfaceInit. They only run while
+   that GUI is selected, so they draw into gui->surface, clipped to it. */
+static UG_S16 surface_area_left;
+static UG_S16 surface_area_right;
+static UG_S16 surface_area_x;
+static UG_S16 surface_area_y;
+
+static UG_COLOR _UG_SurfaceColor( UG_COLOR c )
+{
+   if ( gui->surface->format == SURFACE_FORMAT_COLOR_SWAP ) return (UG_COLOR)((c << 8) | (c >> 8));
+   return c;
+}
+
+static void _UG_SurfacePSet( UG_S16 x, UG_S16 y, UG_COLOR c )
+{
+   if ( x < 0 || y < 0 || x >= gui->surface->width || y >= gui->surface->height ) return;
+
+   gui->surface->p[y*gui->surface->stride+x] = _UG_SurfaceColor(c);
+}
+
+static UG_RESULT _UG_SurfaceFillFrame( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c )
+{
+   UG_S16 i,j;
+   UG_U16* dst;
+
+   if ( x1 < 0 ) x1 = 0;
+   if ( y1 < 0 ) y1 = 0;
+   if ( x2 > gui->surface->width-1 ) x2 = gui->surface->width-1;
+   if ( y2 > gui->surface->height-1 ) y2 = gui->surface->height-1;
+   if ( x1 > x2 || y1 > y2 ) return UG_RESULT_OK;
+
+   c = _UG_SurfaceColor(c);
+
+   for( j=y1;j<=y2;j++ )
+   {
+      dst = gui->surface->p + j*gui->surface->stride;
+      for( i=x1;i<=x2;i++ )
+      {
+         dst[i] = c;
+      }
+   }
+
+   return UG_RESULT_OK;
+}
+
+static void _UG_SurfacePushPixel( UG_COLOR c )
+{
+   _UG_SurfacePSet(surface_area_x,surface_area_y,c);
+
+   if ( ++surface_area_x > surface_area_right )
+   {
+      surface_area_x = surface_area_left;
+      surface_area_y++;
+   }
+}
+
+static void* _UG_SurfaceFillArea( UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2 )
+{
+   surface_area_left = x1;
+   surface_area_right = x2;
+   surface_area_x = x1;
+   surface_area_y = y1;
+
+   return (void*)_UG_SurfacePushPixel;
+}
+
+/* swap is set when the source is byte swapped from UG_COLOR */
+static void _UG_SurfaceCopy( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_U16* p, UG_U8 swap )
+{
+   UG_S16 i,j,xs,ys,xe,ye;
+   UG_U16* dst;
+   const UG_U16* src;
+
+   xs = ( x < 0 ) ? 0 : x;
+   ys = ( y < 0 ) ? 0 : y;
+   xe = ( x+w-1 > gui->surface->width-1 ) ? gui->surface->width-1 : x+w-1;
+   ye = ( y+h-1 > gui->surface->height-1 ) ? gui->surface->height-1 : y+h-1;
+   if ( xs > xe || ys > ye ) return;
+
+   if ( gui->surface->format == SURFACE_FORMAT_COLOR_SWAP ) swap = !swap;
+
+   for( j=ys;j<=ye;j++ )
+   {
+      src = p + (j-y)*stride + (xs-x);
+      dst = gui->surface->p + j*gui->surface->stride + xs;
+      if ( swap )
+      {
+         for( i=0;i<=xe-xs;i++ ) dst[i] = (UG_U16)((src[i] << 8) | (src[i] >> 8));
+      }
+      else
+      {
+         for( i=0;i<=xe-xs;i++ ) dst[i] = src[i];
+      }
+   }
+}
+
+static UG_RESULT _UG_SurfaceBlit( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p )
+{
+   _UG_SurfaceCopy(x,y,w,h,stride,p,0);
+   return UG_RESULT_OK;
+}
+
+static UG_RESULT _UG_SurfaceBlitSwap( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p )
+{
+   _UG_SurfaceCopy(x,y,w,h,stride,p,1);
+   return UG_RESULT_OK;
+}
+
+/* Set up g to draw into s, and select it */
+UG_S16 UG_SurfaceInit( UG_GUI* g, UG_SURFACE* s )
+{
+   UG_Init(g,_UG_SurfacePSet,s->width,s->height);
+   g->surface = s;
+
+   UG_DriverRegister(DRIVER_FILL_FRAME,(void*)_UG_SurfaceFillFrame);
+   UG_DriverRegister(DRIVER_FILL_AREA,(void*)_UG_SurfaceFillArea);
+   UG_DriverRegister(DRIVER_BLIT,(void*)_UG_SurfaceBlit);
+   UG_DriverRegister(DRIVER_BLIT_SWAP,(void*)_UG_SurfaceBlitSwap);
+
+   return 1;
+}
+
+/* Point g at another surface. g keeps the size it was set up with, which is
+   where text wraps; drawing is clipped to s. */
+void UG_SurfaceSet( UG_GUI* g, UG_SURFACE* s )
+{
+   g->surface = s;
+}
+
+/* Clip the source rectangle to the surface. Returns 0 if nothing is left. */
+static UG_U8 _UG_SurfaceClip( const UG_SURFACE* s, UG_S16* sx, UG_S16* sy, UG_S16* w, UG_S16* h, UG_S16* x, UG_S16* y )
+{
+   if ( *sx < 0 ) { *w += *sx; *x -= *sx; *sx = 0; }
+   if ( *sy < 0 ) { *h += *sy; *y -= *sy; *sy = 0; }
+   if ( *sx+*w > s->width ) *w = s->width - *sx;
+   if ( *sy+*h > s->height ) *h = s->height - *sy;
+
+   return ( *w > 0 && *h > 0 );
+}
+
+/* Copy part of a surface onto the selected GUI, at (x, y) */
+void UG_SurfaceBlit( const UG_SURFACE* s, UG_S16 sx, UG_S16 sy, UG_S16 w, UG_S16 h, UG_S16 x, UG_S16 y )
+{
+   if ( !_UG_SurfaceClip(s,&sx,&sy,&w,&h,&x,&y) ) return;
+
+   _UG_BlitRGB565(x,y,w,h,s->stride,s->p+sy*s->stride+sx,
+      ( s->format == SURFACE_FORMAT_COLOR_SWAP ) ? DRIVER_BLIT_SWAP : DRIVER_BLIT);
+}
+
+/* The same, leaving out the pixels of color key: each run of other pixels
+   in a row is one blit. */
+void UG_SurfaceBlitKey( const UG_SURFACE* s, UG_S16 sx, UG_S16 sy, UG_S16 w, UG_S16 h, UG_S16 x, UG_S16 y, UG_COLOR key )
+{
+   UG_S16 i,j,start;
+   UG_U8 type;
+   const UG_U16* src;
+
+   if ( !_UG_SurfaceClip(s,&sx,&sy,&w,&h,&x,&y) ) return;
+
+   type = DRIVER_BLIT;
+   if ( s->format == SURFACE_FORMAT_COLOR_SWAP )
+   {
+      type = DRIVER_BLIT_SWAP;
+      key = (UG_COLOR)((key << 8) | (key >> 8));
+   }
+
+   for( j=0;j<h;j++ )
+   {
+      src = s->p + (sy+j)*s->stride + sx;
+      i = 0;
+      while ( i < w )
+      {
+         while ( i < w && src[i] == key ) i++;
+         start = i;
+         while ( i < w && src[i] != key ) i++;
+         if ( i > start ) _UG_BlitRGB565(x+start,y+j,i-start,1,s->stride,src+start,type);
+      }
+   }
+}
+#endif
+#endif
+
 void UG_DrawBMP( UG_S16 xp, UG_S16 yp, UG_BMP* bmp )
 {
    UG_S16 x,y,xs;
@@ -5898,6 +6416,15 @@ void UG_DrawBMP( UG_S16 xp, UG_S16 yp, UG_BMP* bmp )
    /* Only support 16 BPP so far */
    if ( bmp->bpp == BMP_BPP_16 )
    {
+      #ifdef USE_COLOR_RGB565
+      /* Already in the color format: no need to go through RGB888 */
+      #ifdef USE_COLOR_RGB565_BE
+      UG_BlitRGB565Swap(xp,yp,bmp->width,bmp->height,bmp->width,(const UG_U16*)bmp->p);
+      #else
+      UG_BlitRGB565(xp,yp,bmp->width,bmp->height,bmp->width,(const UG_U16*)bmp->p);
+      #endif
+      return;
+      #endif
       p = (UG_U16*)bmp->p;
    } else if ( bmp->bpp == BMP_BPP_1 ) {
        UG_U8* p1 = (UG_U8*)bmp->p;
@@ -5974,8 +6501,8 @@ UG_RESULT UG_WindowCreate( UG_WINDOW* wnd, UG_OBJECT* objlst, UG_U8 objcnt, void
    wnd->bc = 0xF0F0F0;
    #endif
    #ifdef USE_COLOR_RGB565
-   wnd->fc = 0x0000;
-   wnd->bc = 0xEF7D;
+   wnd->fc = UG_RGB565(0x0000);
+   wnd->bc = UG_RGB565(0xEF7D);
    #endif
    wnd->xs = 0;
    wnd->ys = 0;
@@ -104,6 +104,12 @@ typedef UG_U32                                        UG_COLOR;
 #endif
 #ifdef USE_COLOR_RGB565
 typedef UG_U16                                        UG_COLOR;
+#ifdef USE_COLOR_RGB565_BE
+/* Colors are stored byte swapped, in the order the panel expects them */
+#define UG_RGB565(c)                                  ((UG_COLOR)((((c) & 0x00FF) << 8) | (((c) & 0xFF00) >> 8)))
+#else
+#define UG_RGB565(c)                                  ((UG_COLOR)(c))
+#endif
 #endif
 /* -------------------------------------------------------------------------------- */
 /* -- DEFINES                                                                    -- */
@@ -548,10 +554,35 @@ typedef struct
 #define DRIVER_ENABLED                                (1<<1)
 
 /* Supported drivers */
-#define NUMBER_OF_DRIVERS                             3
+#define NUMBER_OF_DRIVERS                             5
 #define DRIVER_DRAW_LINE                              0
 #define DRIVER_FILL_FRAME                             1
 #define DRIVER_FILL_AREA                              2
+#define DRIVER_BLIT                                   3
+#define DRIVER_BLIT_SWAP                              4
+
+/* DRIVER_BLIT copies a block of colors, stride colors per row:
+   UG_RESULT blit( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p )
+   DRIVER_BLIT_SWAP takes the same arguments, with every color byte swapped. */
+
+/* -------------------------------------------------------------------------------- */
+/* -- µGUI SURFACE                                                               -- */
+/* -------------------------------------------------------------------------------- */
+#ifdef USE_SURFACES
+/* A block of RGB565 pixels that a GUI can draw into instead of the screen */
+typedef struct
+{
+   UG_U16* p;
+   UG_S16 width;
+   UG_S16 height;
+   UG_S16 stride;       /* pixels from one row to the next */
+   UG_U8 format;
+} UG_SURFACE;
+
+/* Surface formats */
+#define SURFACE_FORMAT_COLOR                          0     /* UG_COLOR */
+#define SURFACE_FORMAT_COLOR_SWAP                     1     /* UG_COLOR byte swapped */
+#endif
 
 /* -------------------------------------------------------------------------------- */
 /* -- µGUI CORE STRUCTURE                                                        -- */
@@ -584,6 +615,9 @@ typedef struct
    UG_COLOR desktop_color;
    UG_U8 state;
    UG_DRIVER driver[NUMBER_OF_DRIVERS];
+   #ifdef USE_SURFACES
+   UG_SURFACE* surface;
+   #endif
 } UG_GUI;
 
 #define UG_SATUS_WAIT_FOR_UPDATE                      (1<<0)
@@ -593,145 +627,145 @@ typedef struct
 /* -- Source: http://www.rapidtables.com/web/color/RGB_Color.htm                 -- */
 /* -------------------------------------------------------------------------------- */
 #ifdef USE_COLOR_RGB565
-#define C_MAROON                       0x8000
-#define C_DARK_RED                     0x8800
-#define C_BROWN                        0xA145
-#define C_FIREBRICK                    0xB104
-#define C_CRIMSON                      0xD8A7
-#define C_RED                          0xF800
-#define C_TOMATO                       0xFB09
-#define C_CORAL                        0xFBEA
-#define C_INDIAN_RED                   0xCAEB
-#define C_LIGHT_CORAL                  0xEC10
-#define C_DARK_SALMON                  0xE4AF
-#define C_SALMON                       0xF40E
-#define C_LIGHT_SALMON                 0xFD0F
-#define C_ORANGE_RED                   0xFA20
-#define C_DARK_ORANGE                  0xFC60
-#define C_ORANGE                       0xFD20
-#define C_GOLD                         0xFEA0
-#define C_DARK_GOLDEN_ROD              0xB421
-#define C_GOLDEN_ROD                   0xDD24
-#define C_PALE_GOLDEN_ROD              0xEF35
-#define C_DARK_KHAKI                   0xBDAD
-#define C_KHAKI                        0xEF31
-#define C_OLIVE                        0x8400
-#define C_YELLOW                       0xFFE0
-#define C_YELLOW_GREEN                 0x9E66
-#define C_DARK_OLIVE_GREEN             0x5346
-#define C_OLIVE_DRAB                   0x6C64
-#define C_LAWN_GREEN                   0x7FC0
-#define C_CHART_REUSE                  0x7FE0
-#define C_GREEN_YELLOW                 0xAFE6
-#define C_DARK_GREEN                   0x0320
-#define C_GREEN                        0x07E0
-#define C_FOREST_GREEN                 0x2444
-#define C_LIME                         0x07E0
-#define C_LIME_GREEN                   0x3666
-#define C_LIGHT_GREEN                  0x9772
-#define C_PALE_GREEN                   0x97D2
-#define C_DARK_SEA_GREEN               0x8DD1
-#define C_MEDIUM_SPRING_GREEN          0x07D3
-#define C_SPRING_GREEN                 0x07EF
-#define C_SEA_GREEN                    0x344B
-#define C_MEDIUM_AQUA_MARINE           0x6675
-#define C_MEDIUM_SEA_GREEN             0x3D8E
-#define C_LIGHT_SEA_GREEN              0x2595
-#define C_DARK_SLATE_GRAY              0x328A
-#define C_TEAL                         0x0410
-#define C_DARK_CYAN                    0x0451
-#define C_AQUA                         0x07FF
-#define C_CYAN                         0x07FF
-#define C_LIGHT_CYAN                   0xDFFF
-#define C_DARK_TURQUOISE               0x0679
-#define C_TURQUOISE                    0x46F9
-#define C_MEDIUM_TURQUOISE             0x4E99
-#define C_PALE_TURQUOISE               0xAF7D
-#define C_AQUA_MARINE                  0x7FFA
-#define C_POWDER_BLUE                  0xAEFC
-#define C_CADET_BLUE                   0x64F3
-#define C_STEEL_BLUE                   0x4C16
-#define C_CORN_FLOWER_BLUE             0x64BD
-#define C_DEEP_SKY_BLUE                0x05FF
-#define C_DODGER_BLUE                  0x249F
-#define C_LIGHT_BLUE                   0xAEBC
-#define C_SKY_BLUE                     0x867D
-#define C_LIGHT_SKY_BLUE               0x867E
-#define C_MIDNIGHT_BLUE                0x18CE
-#define C_NAVY                         0x0010
-#define C_DARK_BLUE                    0x0011
-#define C_MEDIUM_BLUE                  0x0019
-#define C_BLUE                         0x001F
-#define C_ROYAL_BLUE                   0x435B
-#define C_BLUE_VIOLET                  0x897B
-#define C_INDIGO                       0x4810
-#define C_DARK_SLATE_BLUE              0x49F1
-#define C_SLATE_BLUE                   0x6AD9
-#define C_MEDIUM_SLATE_BLUE            0x7B5D
-#define C_MEDIUM_PURPLE                0x939B
-#define C_DARK_MAGENTA                 0x8811
-#define C_DARK_VIOLET                  0x901A
-#define C_DARK_ORCHID                  0x9999
-#define C_MEDIUM_ORCHID                0xBABA
-#define C_PURPLE                       0x8010
-#define C_THISTLE                      0xD5FA
-#define C_PLUM                         0xDD1B
-#define C_VIOLET                       0xEC1D
-#define C_MAGENTA                      0xF81F
-#define C_ORCHID                       0xDB9A
-#define C_MEDIUM_VIOLET_RED            0xC0B0
-#define C_PALE_VIOLET_RED              0xDB92
-#define C_DEEP_PINK                    0xF8B2
-#define C_HOT_PINK                     0xFB56
-#define C_LIGHT_PINK                   0xFDB7
-#define C_PINK                         0xFDF9
-#define C_ANTIQUE_WHITE                0xF75A
-#define C_BEIGE                        0xF7BB
-#define C_BISQUE                       0xFF18
-#define C_BLANCHED_ALMOND              0xFF59
-#define C_WHEAT                        0xF6F6
-#define C_CORN_SILK                    0xFFBB
-#define C_LEMON_CHIFFON                0xFFD9
-#define C_LIGHT_GOLDEN_ROD_YELLOW      0xF7DA
-#define C_LIGHT_YELLOW                 0xFFFB
-#define C_SADDLE_BROWN                 0x8A22
-#define C_SIENNA                       0x9A85
-#define C_CHOCOLATE                    0xD344
-#define C_PERU                         0xCC28
-#define C_SANDY_BROWN                  0xF52C
-#define C_BURLY_WOOD                   0xDDB0
-#define C_TAN                          0xD591
-#define C_ROSY_BROWN                   0xBC71
-#define C_MOCCASIN                     0xFF16
-#define C_NAVAJO_WHITE                 0xFEF5
-#define C_PEACH_PUFF                   0xFED6
-#define C_MISTY_ROSE                   0xFF1B
-#define C_LAVENDER_BLUSH               0xFF7E
-#define C_LINEN                        0xF77C
-#define C_OLD_LACE                     0xFFBC
-#define C_PAPAYA_WHIP                  0xFF7A
-#define C_SEA_SHELL                    0xFFBD
-#define C_MINT_CREAM                   0xF7FE
-#define C_SLATE_GRAY                   0x7412
-#define C_LIGHT_SLATE_GRAY             0x7453
-#define C_LIGHT_STEEL_BLUE             0xAE1B
-#define C_LAVENDER                     0xE73E
-#define C_FLORAL_WHITE                 0xFFDD
-#define C_ALICE_BLUE                   0xEFBF
-#define C_GHOST_WHITE                  0xF7BF
-#define C_HONEYDEW                     0xEFFD
-#define C_IVORY                        0xFFFD
-#define C_AZURE                        0xEFFF
-#define C_SNOW                         0xFFDE
-#define C_BLACK                        0x0000
-#define C_DIM_GRAY                     0x6B4D
-#define C_GRAY                         0x8410
-#define C_DARK_GRAY                    0xAD55
-#define C_SILVER                       0xBDF7
-#define C_LIGHT_GRAY                   0xD69A
-#define C_GAINSBORO                    0xDEDB
-#define C_WHITE_SMOKE                  0xF7BE
-#define C_WHITE                        0xFFFF
+#define C_MAROON                       UG_RGB565(0x8000)
+#define C_DARK_RED                     UG_RGB565(0x8800)
+#define C_BROWN                        UG_RGB565(0xA145)
+#define C_FIREBRICK                    UG_RGB565(0xB104)
+#define C_CRIMSON                      UG_RGB565(0xD8A7)
+#define C_RED                          UG_RGB565(0xF800)
+#define C_TOMATO                       UG_RGB565(0xFB09)
+#define C_CORAL                        UG_RGB565(0xFBEA)
+#define C_INDIAN_RED                   UG_RGB565(0xCAEB)
+#define C_LIGHT_CORAL                  UG_RGB565(0xEC10)
+#define C_DARK_SALMON                  UG_RGB565(0xE4AF)
+#define C_SALMON                       UG_RGB565(0xF40E)
+#define C_LIGHT_SALMON                 UG_RGB565(0xFD0F)
+#define C_ORANGE_RED                   UG_RGB565(0xFA20)
+#define C_DARK_ORANGE                  UG_RGB565(0xFC60)
+#define C_ORANGE                       UG_RGB565(0xFD20)
+#define C_GOLD                         UG_RGB565(0xFEA0)
+#define C_DARK_GOLDEN_ROD              UG_RGB565(0xB421)
+#define C_GOLDEN_ROD                   UG_RGB565(0xDD24)
+#define C_PALE_GOLDEN_ROD              UG_RGB565(0xEF35)
+#define C_DARK_KHAKI                   UG_RGB565(0xBDAD)
+#define C_KHAKI                        UG_RGB565(0xEF31)
+#define C_OLIVE                        UG_RGB565(0x8400)
+#define C_YELLOW                       UG_RGB565(0xFFE0)
+#define C_YELLOW_GREEN                 UG_RGB565(0x9E66)
+#define C_DARK_OLIVE_GREEN             UG_RGB565(0x5346)
+#define C_OLIVE_DRAB                   UG_RGB565(0x6C64)
+#define C_LAWN_GREEN                   UG_RGB565(0x7FC0)
+#define C_CHART_REUSE                  UG_RGB565(0x7FE0)
+#define C_GREEN_YELLOW                 UG_RGB565(0xAFE6)
+#define C_DARK_GREEN                   UG_RGB565(0x0320)
+#define C_GREEN                        UG_RGB565(0x07E0)
+#define C_FOREST_GREEN                 UG_RGB565(0x2444)
+#define C_LIME                         UG_RGB565(0x07E0)
+#define C_LIME_GREEN                   UG_RGB565(0x3666)
+#define C_LIGHT_GREEN                  UG_RGB565(0x9772)
+#define C_PALE_GREEN                   UG_RGB565(0x97D2)
+#define C_DARK_SEA_GREEN               UG_RGB565(0x8DD1)
+#define C_MEDIUM_SPRING_GREEN          UG_RGB565(0x07D3)
+#define C_SPRING_GREEN                 UG_RGB565(0x07EF)
+#define C_SEA_GREEN                    UG_RGB565(0x344B)
+#define C_MEDIUM_AQUA_MARINE           UG_RGB565(0x6675)
+#define C_MEDIUM_SEA_GREEN             UG_RGB565(0x3D8E)
+#define C_LIGHT_SEA_GREEN              UG_RGB565(0x2595)
+#define C_DARK_SLATE_GRAY              UG_RGB565(0x328A)
+#define C_TEAL                         UG_RGB565(0x0410)
+#define C_DARK_CYAN                    UG_RGB565(0x0451)
+#define C_AQUA                         UG_RGB565(0x07FF)
+#define C_CYAN                         UG_RGB565(0x07FF)
+#define C_LIGHT_CYAN                   UG_RGB565(0xDFFF)
+#define C_DARK_TURQUOISE               UG_RGB565(0x0679)
+#define C_TURQUOISE                    UG_RGB565(0x46F9)
+#define C_MEDIUM_TURQUOISE             UG_RGB565(0x4E99)
+#define C_PALE_TURQUOISE               UG_RGB565(0xAF7D)
+#define C_AQUA_MARINE                  UG_RGB565(0x7FFA)
+#define C_POWDER_BLUE                  UG_RGB565(0xAEFC)
+#define C_CADET_BLUE                   UG_RGB565(0x64F3)
+#define C_STEEL_BLUE                   UG_RGB565(0x4C16)
+#define C_CORN_FLOWER_BLUE             UG_RGB565(0x64BD)
+#define C_DEEP_SKY_BLUE                UG_RGB565(0x05FF)
+#define C_DODGER_BLUE                  UG_RGB565(0x249F)
+#define C_LIGHT_BLUE                   UG_RGB565(0xAEBC)
+#define C_SKY_BLUE                     UG_RGB565(0x867D)
+#define C_LIGHT_SKY_BLUE               UG_RGB565(0x867E)
+#define C_MIDNIGHT_BLUE                UG_RGB565(0x18CE)
+#define C_NAVY                         UG_RGB565(0x0010)
+#define C_DARK_BLUE                    UG_RGB565(0x0011)
+#define C_MEDIUM_BLUE                  UG_RGB565(0x0019)
+#define C_BLUE                         UG_RGB565(0x001F)
+#define C_ROYAL_BLUE                   UG_RGB565(0x435B)
+#define C_BLUE_VIOLET                  UG_RGB565(0x897B)
+#define C_INDIGO                       UG_RGB565(0x4810)
+#define C_DARK_SLATE_BLUE              UG_RGB565(0x49F1)
+#define C_SLATE_BLUE                   UG_RGB565(0x6AD9)
+#define C_MEDIUM_SLATE_BLUE            UG_RGB565(0x7B5D)
+#define C_MEDIUM_PURPLE                UG_RGB565(0x939B)
+#define C_DARK_MAGENTA                 UG_RGB565(0x8811)
+#define C_DARK_VIOLET                  UG_RGB565(0x901A)
+#define C_DARK_ORCHID                  UG_RGB565(0x9999)
+#define C_MEDIUM_ORCHID                UG_RGB565(0xBABA)
+#define C_PURPLE                       UG_RGB565(0x8010)
+#define C_THISTLE                      UG_RGB565(0xD5FA)
+#define C_PLUM                         UG_RGB565(0xDD1B)
+#define C_VIOLET                       UG_RGB565(0xEC1D)
+#define C_MAGENTA                      UG_RGB565(0xF81F)
+#define C_ORCHID                       UG_RGB565(0xDB9A)
+#define C_MEDIUM_VIOLET_RED            UG_RGB565(0xC0B0)
+#define C_PALE_VIOLET_RED              UG_RGB565(0xDB92)
+#define C_DEEP_PINK                    UG_RGB565(0xF8B2)
+#define C_HOT_PINK                     UG_RGB565(0xFB56)
+#define C_LIGHT_PINK                   UG_RGB565(0xFDB7)
+#define C_PINK                         UG_RGB565(0xFDF9)
+#define C_ANTIQUE_WHITE                UG_RGB565(0xF75A)
+#define C_BEIGE                        UG_RGB565(0xF7BB)
+#define C_BISQUE                       UG_RGB565(0xFF18)
+#define C_BLANCHED_ALMOND              UG_RGB565(0xFF59)
+#define C_WHEAT                        UG_RGB565(0xF6F6)
+#define C_CORN_SILK                    UG_RGB565(0xFFBB)
+#define C_LEMON_CHIFFON                UG_RGB565(0xFFD9)
+#define C_LIGHT_GOLDEN_ROD_YELLOW      UG_RGB565(0xF7DA)
+#define C_LIGHT_YELLOW                 UG_RGB565(0xFFFB)
+#define C_SADDLE_BROWN                 UG_RGB565(0x8A22)
+#define C_SIENNA                       UG_RGB565(0x9A85)
+#define C_CHOCOLATE                    UG_RGB565(0xD344)
+#define C_PERU                         UG_RGB565(0xCC28)
+#define C_SANDY_BROWN                  UG_RGB565(0xF52C)
+#define C_BURLY_WOOD                   UG_RGB565(0xDDB0)
+#define C_TAN                          UG_RGB565(0xD591)
+#define C_ROSY_BROWN                   UG_RGB565(0xBC71)
+#define C_MOCCASIN                     UG_RGB565(0xFF16)
+#define C_NAVAJO_WHITE                 UG_RGB565(0xFEF5)
+#define C_PEACH_PUFF                   UG_RGB565(0xFED6)
+#define C_MISTY_ROSE                   UG_RGB565(0xFF1B)
+#define C_LAVENDER_BLUSH               UG_RGB565(0xFF7E)
+#define C_LINEN                        UG_RGB565(0xF77C)
+#define C_OLD_LACE                     UG_RGB565(0xFFBC)
+#define C_PAPAYA_WHIP                  UG_RGB565(0xFF7A)
+#define C_SEA_SHELL                    UG_RGB565(0xFFBD)
+#define C_MINT_CREAM                   UG_RGB565(0xF7FE)
+#define C_SLATE_GRAY                   UG_RGB565(0x7412)
+#define C_LIGHT_SLATE_GRAY             UG_RGB565(0x7453)
+#define C_LIGHT_STEEL_BLUE             UG_RGB565(0xAE1B)
+#define C_LAVENDER                     UG_RGB565(0xE73E)
+#define C_FLORAL_WHITE                 UG_RGB565(0xFFDD)
+#define C_ALICE_BLUE                   UG_RGB565(0xEFBF)
+#define C_GHOST_WHITE                  UG_RGB565(0xF7BF)
+#define C_HONEYDEW                     UG_RGB565(0xEFFD)
+#define C_IVORY                        UG_RGB565(0xFFFD)
+#define C_AZURE                        UG_RGB565(0xEFFF)
+#define C_SNOW                         UG_RGB565(0xFFDE)
+#define C_BLACK                        UG_RGB565(0x0000)
+#define C_DIM_GRAY                     UG_RGB565(0x6B4D)
+#define C_GRAY                         UG_RGB565(0x8410)
+#define C_DARK_GRAY                    UG_RGB565(0xAD55)
+#define C_SILVER                       UG_RGB565(0xBDF7)
+#define C_LIGHT_GRAY                   UG_RGB565(0xD69A)
+#define C_GAINSBORO                    UG_RGB565(0xDEDB)
+#define C_WHITE_SMOKE                  UG_RGB565(0xF7BE)
+#define C_WHITE                        UG_RGB565(0xFFFF)
 #endif
 
 #ifdef USE_COLOR_RGB888
@@ -916,6 +950,10 @@ void UG_FontSetVSpace( UG_U16 s );
 void UG_WaitForUpdate( void );
 void UG_Update( void );
 void UG_DrawBMP( UG_S16 xp, UG_S16 yp, UG_BMP* bmp );
+#ifdef USE_COLOR_RGB565
+void UG_BlitRGB565( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_U16* data );
+void UG_BlitRGB565Swap( UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_U16* data );
+#endif
 void UG_TouchUpdate( UG_S16 xp, UG_S16 yp, UG_U8 state );
 
 /* Driver functions */
@@ -923,6 +961,19 @@ void UG_DriverRegister( UG_U8 type, void* driver );
 void UG_DriverEnable( UG_U8 type );
 void UG_DriverDisable( UG_U8 type );
 
+/* Glyph cache functions */
+#ifdef USE_GLYPH_CACHE
+void UG_GlyphCacheClear( void );
+#endif
+
+/* Surface functions */
+#ifdef USE_SURFACES
+UG_S16 UG_SurfaceInit( UG_GUI* g, UG_SURFACE* s );
+void UG_SurfaceSet( UG_GUI* g, UG_SURFACE* s );
+void UG_SurfaceBlit( const UG_SURFACE* s, UG_S16 sx, UG_S16 sy, UG_S16 w, UG_S16 h, UG_S16 x, UG_S16 y );
+void UG_SurfaceBlitKey( const UG_SURFACE* s, UG_S16 sx, UG_S16 sy, UG_S16 w, UG_S16 h, UG_S16 x, UG_S16 y, UG_COLOR key );
+#endif
+
 /* Window functions */
 UG_RESULT UG_WindowCreate( UG_WINDOW* wnd, UG_OBJECT* objlst, UG_U8 objcnt, void (*cb)( UG_MESSAGE* ) );
 UG_RESULT UG_WindowDelete( UG_WINDOW* wnd );
@@ -13,6 +13,10 @@
 //#define USE_COLOR_RGB888   // RGB = 0xFF,0xFF,0xFF
 #define USE_COLOR_RGB565   // RGB = 0bRRRRRGGGGGGBBBBB 
 
+/* Store RGB565 in panel (big-endian) byte order. Comment out to keep the
+   little-endian framebuffer, which is byte swapped on every push. */
+#define USE_COLOR_RGB565_BE
+
 /* Enable needed fonts here */
 #define  USE_FONT_4X6
 #define  USE_FONT_5X8
@@ -61,5 +65,18 @@ typedef signed long int       UG_S32;
 #define USE_PRERENDER_EVENT
 #define USE_POSTRENDER_EVENT
 
+/* Keep expanded characters and draw them by row through DRIVER_BLIT.
+   Each entry holds GLYPH_CACHE_MAX_PIXELS colors plus 20 bytes, about
+   13KB in all with RGB565; larger glyphs are drawn directly. A menu page
+   draws fewer than 64 distinct characters in one 8x12 font, and older
+   ones are evicted when the page changes. */
+#define USE_GLYPH_CACHE
+#define GLYPH_CACHE_ENTRIES                           64
+#define GLYPH_CACHE_MAX_PIXELS                        96    // 8x12
+
+/* Let a GUI draw into an off-screen UG_SURFACE, and blit surfaces onto the
+   selected GUI. Needs USE_COLOR_RGB565. */
+#define USE_SURFACES
+
 
 #endif
@@ -1,4 +1,7 @@
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_wifi.h"
 #include "esp_system.h"
 #include "esp_event.h"
@@ -8,6 +11,7 @@
 #include "esp_partition.h"
 #include "esp_ota_ops.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "esp_flash_data_types.h"
 #include "rom/crc.h"
 
@@ -15,14 +19,17 @@
 
 #include "odroid_sdcard.h"
 #include "odroid_display.h"
+#include "rgb565.h"
 #include "input.h"
 
 #include "../components/ugui/ugui.h"
+#include "ui_fb.h"
 
 
 const char* SD_CARD = "/sd";
 //const char* HEADER = "ODROIDGO_FIRMWARE_V00_00";
 const char* HEADER_V00_01 = "ODROIDGO_FIRMWARE_V00_01";
+const char* HEADER_V00_02 = "ODROIDGO_FIRMWARE_V00_02";
 
 #define FIRMWARE_DESCRIPTION_SIZE (40)
 char FirmwareDescription[FIRMWARE_DESCRIPTION_SIZE];
@@ -45,13 +52,25 @@ typedef struct
     uint32_t length;
 } odroid_partition_t;
 
+// V00_02 adds a table after the tile, so each partition can be checked
+// on its own:
+// <table count=0x00000000>
+// 	<partition ...> <data length=0x00000000 crc=0x00000000>
+// 	[...]
+// </table>
+// <checksum crc=0x00000000> of the file up to here
+typedef struct
+{
+    odroid_partition_t slot;
+    uint32_t length;
+    uint32_t crc;       // of the data
+} odroid_partition_hash_t;
+
 // ------
 
-uint16_t fb[320 * 240];
 UG_GUI gui;
 char tempstring[512];
 
-#define ITEM_COUNT (4)
 char** files;
 int fileCount;
 const char* path = "/sd/odroid/firmware";
@@ -73,26 +92,242 @@ void indicate_error()
     }
 }
 
-static void pset(UG_S16 x, UG_S16 y, UG_COLOR color)
+// Damage is tracked in DAMAGE_TILE_SIZE tiles, see ui_fb.h
+#define DAMAGE_WINDOWS_MAX (DAMAGE_ROWS * ((DAMAGE_COLUMNS + 1) / 2))
+
+// What opening an address window (CASET, PASET, RAMWR) costs, expressed in
+// bytes of pixel data that could have been sent in the same time.
+#define DAMAGE_WINDOW_COST (1024)
+
+// Uncomment to print the windows and bytes sent by each flush
+//#define DAMAGE_REPORT
+
+// Drawn into by pset on the UI task
+ui_damage_map_t damage;
+
+// Tile coordinates, inclusive
+typedef struct
+{
+    short left;
+    short top;
+    short right;
+    short bottom;
+} ui_window_t;
+
+static ui_window_t damage_windows[DAMAGE_WINDOWS_MAX];
+
+// Held by the display task while it flushes
+static QueueHandle_t display_queue;
+SemaphoreHandle_t display_mutex;
+
+
+// Pixel coordinates, inclusive and clipped
+void ui_damage_rect(short x1, short y1, short x2, short y2)
+{
+    for (short row = y1 / DAMAGE_TILE_SIZE; row <= y2 / DAMAGE_TILE_SIZE; ++row)
+    {
+        for (short column = x1 / DAMAGE_TILE_SIZE; column <= x2 / DAMAGE_TILE_SIZE; ++column)
+        {
+            damage.tiles[row][column] = 1;
+        }
+    }
+}
+
+static void ui_window_to_pixels(const ui_window_t* window, short* left, short* top, short* width, short* height)
 {
-    fb[y * 320 + x] = color;
+    short right = (window->right + 1) * DAMAGE_TILE_SIZE;
+    short bottom = (window->bottom + 1) * DAMAGE_TILE_SIZE;
+
+    if (right > 320) right = 320;
+    if (bottom > 240) bottom = 240;
+
+    *left = window->left * DAMAGE_TILE_SIZE;
+    *top = window->top * DAMAGE_TILE_SIZE;
+    *width = right - *left;
+    *height = bottom - *top;
 }
 
-static void ui_update_display()
+static int ui_window_cost(const ui_window_t* window)
+{
+    short left, top, width, height;
+    ui_window_to_pixels(window, &left, &top, &width, &height);
+
+    return DAMAGE_WINDOW_COST + width * height * 2;
+}
+
+// Turn the damaged tiles into as few windows as pays off and clear the map.
+static int ui_damage_collect(ui_damage_map_t* map, ui_window_t* windows)
+{
+    int count = 0;
+
+    // Start with one window per run of damaged tiles in a row
+    for (short row = 0; row < DAMAGE_ROWS; ++row)
+    {
+        short column = 0;
+        while (column < DAMAGE_COLUMNS)
+        {
+            if (!map->tiles[row][column])
+            {
+                ++column;
+                continue;
+            }
+
+            short start = column;
+            while (column < DAMAGE_COLUMNS && map->tiles[row][column]) ++column;
+
+            windows[count].left = start;
+            windows[count].top = row;
+            windows[count].right = column - 1;
+            windows[count].bottom = row;
+            ++count;
+        }
+
+        memset(map->tiles[row], 0, DAMAGE_COLUMNS);
+    }
+
+    // Merge any two windows whose bounding box is cheaper to send than both
+    bool merged = true;
+    while (merged)
+    {
+        merged = false;
+
+        for (int i = 0; i < count; ++i)
+        {
+            for (int j = i + 1; j < count; ++j)
+            {
+                ui_window_t* a = &windows[i];
+                ui_window_t* b = &windows[j];
+
+                ui_window_t both;
+                both.left = a->left < b->left ? a->left : b->left;
+                both.top = a->top < b->top ? a->top : b->top;
+                both.right = a->right > b->right ? a->right : b->right;
+                both.bottom = a->bottom > b->bottom ? a->bottom : b->bottom;
+
+                if (ui_window_cost(&both) <= ui_window_cost(a) + ui_window_cost(b))
+                {
+                    *a = both;
+                    windows[j--] = windows[--count];
+                    merged = true;
+                }
+            }
+        }
+    }
+
+    return count;
+}
+
+// Flushes run on their own task so the UI (and flashing) never waits for
+// SPI. The queue holds at most one request: a newer request absorbs the
+// pending one, and the pixels always come from fb as it is when sent.
+static ui_damage_map_t display_request;
+static ui_damage_map_t display_flush;
+
+static void ui_flush(ui_damage_map_t* map)
+{
+    int count = ui_damage_collect(map, damage_windows);
+#ifdef DAMAGE_REPORT
+    int bytes = 0;
+    ili9341_stats_t before;
+    ili9341_stats_get(&before);
+#endif
+
+    for (int i = 0; i < count; ++i)
+    {
+        short left, top, width, height;
+        ui_window_to_pixels(&damage_windows[i], &left, &top, &width, &height);
+
+        ui_flush_window(left, top, width, height);
+
+#ifdef DAMAGE_REPORT
+        bytes += width * height * 2;
+#endif
+    }
+
+#ifdef DAMAGE_REPORT
+    if (count > 0)
+    {
+        ili9341_stats_t after;
+        ili9341_stats_get(&after);
+
+        printf("%s: windows=%d, bytes=%d, transactions=%u, us=%u\n", __func__,
+            count, bytes, after.transactions - before.transactions,
+            after.write_us - before.write_us);
+    }
+#endif
+}
+
+static void display_task(void *arg)
+{
+    while (true)
+    {
+        xQueuePeek(display_queue, &display_flush, portMAX_DELAY);
+
+        // Hold the mutex from taking the request until it is on the panel
+        xSemaphoreTake(display_mutex, portMAX_DELAY);
+
+        if (xQueueReceive(display_queue, &display_flush, 0) == pdTRUE)
+        {
+            ui_flush(&display_flush);
+        }
+
+        xSemaphoreGive(display_mutex);
+    }
+}
+
+static void ui_display_init()
 {
-    ili9341_write_frame_rectangleLE(0, 0, 320, 240, fb);
+    display_queue = xQueueCreate(1, sizeof(ui_damage_map_t));
+    display_mutex = xSemaphoreCreateMutex();
+
+    if (!display_queue || !display_mutex)
+    {
+        printf("%s: display queue create failed.\n", __func__);
+        abort();
+    }
+
+    // app_main and the flash reader run on core 0. The display task has core
+    // 1, shared only with the flash writer below it.
+    xTaskCreatePinnedToCore(&display_task, "display_task", 1024 * 3, NULL, 5, NULL, 1);
 }
 
-static void ui_draw_image(short x, short y, short width, short height, uint16_t* data)
+// Does not block: queues the damage since the last call for the display task.
+static void ui_update_display()
 {
-    for (short i = 0 ; i < height; ++i)
+    if (xQueueReceive(display_queue, &display_request, 0) == pdTRUE)
     {
-        for (short j = 0; j < width; ++j)
+        for (short row = 0; row < DAMAGE_ROWS; ++row)
         {
-            uint16_t pixel = data[i * width + j];
-            UG_DrawPixel(x + j, y + i, pixel);
+            for (short column = 0; column < DAMAGE_COLUMNS; ++column)
+            {
+                display_request.tiles[row][column] |= damage.tiles[row][column];
+            }
         }
     }
+    else
+    {
+        display_request = damage;
+    }
+
+    memset(&damage, 0, sizeof(damage));
+
+    xQueueOverwrite(display_queue, &display_request);
+}
+
+// Block until every queued flush has reached the panel. Needed before using
+// the ili9341_* functions directly from the UI task.
+static void ui_wait_display()
+{
+    while (true)
+    {
+        xSemaphoreTake(display_mutex, portMAX_DELAY);
+        bool idle = (uxQueueMessagesWaiting(display_queue) == 0);
+        xSemaphoreGive(display_mutex);
+
+        if (idle) break;
+
+        vTaskDelay(1);
+    }
 }
 
 // TODO: default bad image tile
@@ -127,7 +362,9 @@ void ui_firmware_image_get(const char* filename, uint16_t* outData)
         goto ui_firmware_image_get_exit;
     }
 
-    if (strncmp(HEADER_V00_01, header, headerLength) != 0)
+    // the tile is in the same place in V00_02
+    if (strncmp(HEADER_V00_01, header, headerLength) != 0 &&
+        strncmp(HEADER_V00_02, header, headerLength) != 0)
     {
         memset(outData, DEFAULT_DATA, TILE_LENGTH);
         goto ui_firmware_image_get_exit;
@@ -156,6 +393,19 @@ ui_firmware_image_get_exit:
     fclose(file);
 }
 
+static void ui_init()
+{
+    UG_Init(&gui, pset, 320, 240);
+    UG_DriverRegister(DRIVER_FILL_FRAME, (void*)ui_fill_frame);
+    UG_DriverRegister(DRIVER_BLIT, (void*)ui_blit);
+    UG_DriverRegister(DRIVER_BLIT_SWAP, (void*)ui_blit_swap);
+#ifndef UI_BAND_RENDERER
+    UG_DriverRegister(DRIVER_FILL_AREA, (void*)ui_fill_area);
+    UG_DriverRegister(DRIVER_DRAW_LINE, (void*)ui_draw_line);
+#endif
+    ui_display_init();
+}
+
 static void ClearScreen()
 {
 }
@@ -167,26 +417,26 @@ static void UpdateDisplay()
 
 static void DisplayError(const char* message)
 {
-    UG_FontSelect(&FONT_8X12);
+    ui_font(&FONT_8X12);
     short left = (320 / 2) - (strlen(message) * 9 / 2);
     short top = (240 / 2) - (12 / 2);
-    UG_SetForecolor(C_RED);
-    UG_SetBackcolor(C_WHITE);
-    UG_FillFrame(0, top, 319, top + 12, C_WHITE);
-    UG_PutString(left, top, message);
+    ui_forecolor(C_RED);
+    ui_backcolor(C_WHITE);
+    ui_fill(0, top, 319, top + 12, C_WHITE);
+    ui_string(left, top, message);
 
     UpdateDisplay();
 }
 
 static void DisplayMessage(const char* message)
 {
-    UG_FontSelect(&FONT_8X12);
+    ui_font(&FONT_8X12);
     short left = (320 / 2) - (strlen(message) * 9 / 2);
     short top = (240 / 2) + 8 + (12 / 2) + 16;
-    UG_SetForecolor(C_BLACK);
-    UG_SetBackcolor(C_WHITE);
-    UG_FillFrame(0, top, 319, top + 12, C_WHITE);
-    UG_PutString(left, top, message);
+    ui_forecolor(C_BLACK);
+    ui_backcolor(C_WHITE);
+    ui_fill(0, top, 319, top + 12, C_WHITE);
+    ui_string(left, top, message);
 
     UpdateDisplay();
 }
@@ -201,12 +451,12 @@ static void DisplayProgress(int percent)
 
     short left = (320 / 2) - (WIDTH / 2);
     short top = (240 / 2) - (HEIGHT / 2) + 16;
-    UG_FillFrame(left - 1, top - 1, left + WIDTH + 1, top + HEIGHT + 1, C_WHITE);
-    UG_DrawFrame(left - 1, top - 1, left + WIDTH + 1, top + HEIGHT + 1, C_BLACK);
+    ui_fill(left - 1, top - 1, left + WIDTH + 1, top + HEIGHT + 1, C_WHITE);
+    ui_frame(left - 1, top - 1, left + WIDTH + 1, top + HEIGHT + 1, C_BLACK);
 
     if (FILL_WIDTH > 0)
     {
-        UG_FillFrame(left, top, left + FILL_WIDTH, top + HEIGHT, C_GREEN);
+        ui_fill(left, top, left + FILL_WIDTH, top + HEIGHT, C_GREEN);
     }
 
     //UpdateDisplay();
@@ -214,26 +464,26 @@ static void DisplayProgress(int percent)
 
 static void DisplayFooter(const char* message)
 {
-    UG_FontSelect(&FONT_8X12);
+    ui_font(&FONT_8X12);
     short left = (320 / 2) - (strlen(message) * 9 / 2);
     short top = 240 - (16 * 2) - 8;
-    UG_SetForecolor(C_BLACK);
-    UG_SetBackcolor(C_WHITE);
-    UG_FillFrame(0, top, 319, top + 12, C_WHITE);
-    UG_PutString(left, top, message);
+    ui_forecolor(C_BLACK);
+    ui_backcolor(C_WHITE);
+    ui_fill(0, top, 319, top + 12, C_WHITE);
+    ui_string(left, top, message);
 
     UpdateDisplay();
 }
 
 static void DisplayHeader(const char* message)
 {
-    UG_FontSelect(&FONT_8X12);
+    ui_font(&FONT_8X12);
     short left = (320 / 2) - (strlen(message) * 9 / 2);
     short top = (16 + 8);
-    UG_SetForecolor(C_BLACK);
-    UG_SetBackcolor(C_WHITE);
-    UG_FillFrame(0, top, 319, top + 12, C_WHITE);
-    UG_PutString(left, top, message);
+    ui_forecolor(C_BLACK);
+    ui_backcolor(C_WHITE);
+    ui_fill(0, top, 319, top + 12, C_WHITE);
+    ui_string(left, top, message);
 
     UpdateDisplay();
 }
@@ -244,6 +494,8 @@ void boot_application()
 {
     printf("Booting application.\n");
 
+    ui_wait_display();
+
     // Set firmware active
     const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP,
         ESP_PARTITION_SUBTYPE_APP_OTA_0, NULL);
@@ -410,9 +662,532 @@ static void ui_draw_title();
 
 //uint8_t tileData[TILE_LENGTH];
 
+// Write files without reading them whole for their CRC first. Each
+// partition is read back once written and checked against the CRC from
+// the V00_02 partition table, or that of the data as it was read from a
+// V00_01 file, and the file CRC is checked at the end unless an installed
+// partition was stepped over (see FLASH_DIFFERENTIAL). That saves a read
+// of the file, but a corrupt file is only found after it has overwritten
+// the installed partitions: the partition table is left alone and the menu
+// is set to boot instead.
+// Comment out to verify every file first.
+#define FLASH_SINGLE_PASS
+
+// Read the SD card on the calling task and erase and write flash on a writer
+// task on core 1, below the display task. FLASH_PIPELINE_BUFFERS blocks are
+// passed between them through queues, so the writer erases and writes while
+// the reader waits for SD card transfers.
+// Comment out to read and write in turn on the calling task.
+#define FLASH_PIPELINE
+#define FLASH_PIPELINE_BUFFERS (4)
+
+#define FLASH_BLOCK_SIZE (4096)
+
+// Erase units: 64 KB blocks where aligned, 4 KB sectors elsewhere
+#define FLASH_ERASE_BLOCK_SIZE (64 * 1024)
+#define FLASH_ERASE_SECTOR_SIZE (4096)
+
+// Compare each sector read from the SD card with flash and leave it alone
+// when it already holds the data, as it mostly does when reinstalling the
+// same build. The first FLASH_COMPARE_AHEAD sectors of each 64 KB block are
+// held back until they have been compared: when all of them differ, the
+// block most likely does too and is erased whole, otherwise it is erased
+// and written sector by sector.
+// Comment out to always erase and write, except for V00_02 partitions whose
+// CRC flash already holds: those are stepped over in the file.
+#define FLASH_DIFFERENTIAL
+
+// A 64 KB block erase takes about as long as erasing 4 sectors. Without the
+// pipeline there is only the one buffer to hold.
+#ifdef FLASH_PIPELINE
+#define FLASH_COMPARE_AHEAD (FLASH_PIPELINE_BUFFERS)
+#else
+#define FLASH_COMPARE_AHEAD (1)
+#endif
+
+// Where an install spends its time, in microseconds
+typedef struct
+{
+    int64_t start;
+    int64_t read;
+    int64_t erase;
+    int64_t write;
+    int64_t stream;         // inside flash_stream
+    int64_t reader_wait;    // reader waiting for a free buffer or the writer
+    int64_t writer_wait;    // writer waiting for a full buffer
+    int64_t compare;        // reading flash back to compare
+    uint32_t skipped;       // sectors that already held their data
+    uint32_t skipped_bytes;
+} flash_timing_t;
+
+static void flash_report_timing(const flash_timing_t* timing)
+{
+    ili9341_stats_t display;
+    ili9341_stats_get(&display);
+
+    int64_t total = esp_timer_get_time() - timing->start;
+#ifdef FLASH_PIPELINE
+    // erase and write run on the writer task, alongside the reads
+    int64_t other = total - timing->read - timing->reader_wait;
+#else
+    int64_t other = total - timing->read - timing->erase - timing->write;
+#endif
+
+    printf("%s: total=%ums, sd read=%ums, erase=%ums, write=%ums, other=%ums\n", __func__,
+        (uint32_t)(total / 1000), (uint32_t)(timing->read / 1000),
+        (uint32_t)(timing->erase / 1000), (uint32_t)(timing->write / 1000),
+        (uint32_t)(other / 1000));
+
+#ifdef FLASH_PIPELINE
+    if (timing->stream > 0)
+    {
+        // share of the streaming time each stage spent working and waiting
+        printf("%s: pipeline=%ums, reader busy=%d%% waiting=%d%%, writer busy=%d%% waiting=%d%%\n", __func__,
+            (uint32_t)(timing->stream / 1000),
+            (int)(timing->read * 100 / timing->stream),
+            (int)(timing->reader_wait * 100 / timing->stream),
+            (int)((timing->erase + timing->write) * 100 / timing->stream),
+            (int)(timing->writer_wait * 100 / timing->stream));
+    }
+#endif
+
+#ifdef FLASH_DIFFERENTIAL
+    printf("%s: compare=%ums, sectors skipped=%u, bytes saved=%u\n", __func__,
+        (uint32_t)(timing->compare / 1000), timing->skipped, timing->skipped_bytes);
+#endif
+
+    printf("%s: display=%ums (writes=%u, %ums; fills=%u, %ums), spi wait=%ums, transactions=%u, bytes=%u\n", __func__,
+        (display.write_us + display.fill_us) / 1000,
+        display.write_calls, display.write_us / 1000,
+        display.fill_calls, display.fill_us / 1000,
+        display.wait_us / 1000, display.transactions, display.bytes);
+}
+
+// One block of data on its way from the SD card to flash
+typedef struct
+{
+    uint8_t* data;      // FLASH_BLOCK_SIZE bytes, DMA capable
+    size_t address;
+    size_t count;       // bytes of data to write at address
+    size_t erase;       // if not 0, bytes to erase from address on, ahead of the writes
+    bool last;          // the writer stops after this block
+} flash_block_t;
+
+// The part of a range still to be erased
+typedef struct
+{
+    size_t address;     // erased up to here
+    size_t end;
+} flash_eraser_t;
+
+// Erases the next unit of the range. Returns the error to display, or NULL.
+static const char* flash_erase_next(flash_eraser_t* eraser, flash_timing_t* timing)
+{
+    size_t size = FLASH_ERASE_SECTOR_SIZE;
+    if ((eraser->address & (FLASH_ERASE_BLOCK_SIZE - 1)) == 0 &&
+        eraser->end - eraser->address >= FLASH_ERASE_BLOCK_SIZE)
+    {
+        size = FLASH_ERASE_BLOCK_SIZE;
+    }
+
+    int64_t timer = esp_timer_get_time();
+    esp_err_t ret = spi_flash_erase_range(eraser->address, size);
+    timing->erase += esp_timer_get_time() - timer;
+    if (ret != ESP_OK)
+    {
+        printf("spi_flash_erase_range failed. address=%#08x, size=%#x\n", (unsigned)eraser->address, (unsigned)size);
+        return "ERASE ERROR";
+    }
+
+    eraser->address += size;
+    return NULL;
+}
+
+// Erases whatever the block needs that has not been erased ahead of it,
+// then writes it. Returns the error to display, or NULL.
+static const char* flash_block_write(const flash_block_t* block, flash_eraser_t* eraser, flash_timing_t* timing)
+{
+    int64_t timer;
+    esp_err_t ret;
+
+    if (block->erase > 0)
+    {
+        eraser->address = block->address;
+        eraser->end = block->address + block->erase;
+    }
+
+    if (block->count == 0) return NULL;
+
+    while (eraser->address < eraser->end &&
+        eraser->address < block->address + block->count)
+    {
+        const char* error = flash_erase_next(eraser, timing);
+        if (error) return error;
+    }
+
+    timer = esp_timer_get_time();
+    ret = spi_flash_write(block->address, block->data, block->count);
+    timing->write += esp_timer_get_time() - timer;
+    if (ret != ESP_OK)
+    {
+        printf("spi_flash_write failed. address=%#08x\n", (unsigned)block->address);
+        return "WRITE ERROR";
+    }
+
+    return NULL;
+}
+
+#ifdef FLASH_PIPELINE
+static QueueHandle_t flash_free_queue;  // empty buffers, for the reader
+static QueueHandle_t flash_full_queue;  // filled buffers, for the writer
+static QueueHandle_t flash_done_queue;  // the writer's error, or NULL, once it stops
+
+static void flash_writer_task(void* arg)
+{
+    flash_timing_t* timing = (flash_timing_t*)arg;
+    flash_eraser_t eraser = { 0, 0 };
+    const char* error = NULL;
+
+    while (true)
+    {
+        flash_block_t block;
+
+        // With nothing to write, erase ahead of the write cursor
+        if (!error && eraser.address < eraser.end)
+        {
+            if (xQueueReceive(flash_full_queue, &block, 0) != pdTRUE)
+            {
+                error = flash_erase_next(&eraser, timing);
+                continue;
+            }
+        }
+        else
+        {
+            int64_t timer = esp_timer_get_time();
+            xQueueReceive(flash_full_queue, &block, portMAX_DELAY);
+            timing->writer_wait += esp_timer_get_time() - timer;
+        }
+
+        // after an error keep taking blocks, so the reader never stalls
+        if (!error) error = flash_block_write(&block, &eraser, timing);
+
+        bool last = block.last;
+        xQueueSend(flash_free_queue, &block, portMAX_DELAY);
+
+        if (last) break;
+    }
+
+    xQueueSend(flash_done_queue, &error, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void flash_pipeline_init()
+{
+    flash_free_queue = xQueueCreate(FLASH_PIPELINE_BUFFERS, sizeof(flash_block_t));
+    flash_full_queue = xQueueCreate(FLASH_PIPELINE_BUFFERS, sizeof(flash_block_t));
+    flash_done_queue = xQueueCreate(1, sizeof(const char*));
+    if (!flash_free_queue || !flash_full_queue || !flash_done_queue)
+    {
+        DisplayError("PIPELINE MEMORY ERROR");
+        indicate_error();
+    }
+
+    for (int i = 0; i < FLASH_PIPELINE_BUFFERS; ++i)
+    {
+        flash_block_t block;
+        memset(&block, 0, sizeof(block));
+
+        block.data = heap_caps_malloc(FLASH_BLOCK_SIZE, MALLOC_CAP_DMA);
+        if (!block.data)
+        {
+            DisplayError("DATA MEMORY ERROR");
+            indicate_error();
+        }
+
+        xQueueSend(flash_free_queue, &block, portMAX_DELAY);
+    }
+}
+
+static void flash_pipeline_free()
+{
+    flash_block_t block;
+    while (xQueueReceive(flash_free_queue, &block, 0) == pdTRUE)
+    {
+        free(block.data);
+    }
+
+    vQueueDelete(flash_free_queue);
+    vQueueDelete(flash_full_queue);
+    vQueueDelete(flash_done_queue);
+}
+#endif
+
+// Takes an empty block for the reader
+static void flash_block_take(flash_block_t* block, void* data, flash_timing_t* timing)
+{
+#ifdef FLASH_PIPELINE
+    int64_t timer = esp_timer_get_time();
+    xQueueReceive(flash_free_queue, block, portMAX_DELAY);
+    timing->reader_wait += esp_timer_get_time() - timer;
+#else
+    block->data = data;
+#endif
+
+    block->count = 0;
+    block->erase = 0;
+    block->last = false;
+}
+
+// Reads count bytes from file into the block, for address. Data is added to
+// checksum and part_checksum unless they are NULL.
+static void flash_block_read(FILE* file, flash_block_t* block, size_t address, size_t count,
+    uint32_t* checksum, uint32_t* part_checksum, flash_timing_t* timing)
+{
+    block->address = address;
+    block->count = count;
+
+    // read exactly the block's data, so what follows in the file needs no
+    // seek
+    int64_t timer = esp_timer_get_time();
+    size_t read = fread(block->data, 1, count, file);
+    timing->read += esp_timer_get_time() - timer;
+    if (read != count)
+    {
+        DisplayError("DATA READ ERROR");
+        indicate_error();
+    }
+
+    if (checksum) *checksum = crc32_le(*checksum, block->data, count);
+    if (part_checksum) *part_checksum = crc32_le(*part_checksum, block->data, count);
+}
+
+// Hands the block to the writer, or writes it
+static void flash_block_send(const flash_block_t* block, flash_eraser_t* eraser, flash_timing_t* timing)
+{
+#ifdef FLASH_PIPELINE
+    xQueueSend(flash_full_queue, block, portMAX_DELAY);
+#else
+    const char* error = flash_block_write(block, eraser, timing);
+    if (error)
+    {
+        DisplayError(error);
+        indicate_error();
+    }
+#endif
+}
+
+#ifdef FLASH_DIFFERENTIAL
+static uint8_t flash_compare_data[FLASH_ERASE_SECTOR_SIZE];
+
+// True when flash already holds the block's data
+static bool flash_block_matches(const flash_block_t* block, flash_timing_t* timing)
+{
+    int64_t timer = esp_timer_get_time();
+    esp_err_t ret = spi_flash_read(block->address, flash_compare_data, block->count);
+    timing->compare += esp_timer_get_time() - timer;
+
+    return ret == ESP_OK && memcmp(flash_compare_data, block->data, block->count) == 0;
+}
+
+// Writes a sector block that differs from flash, erasing its sector first,
+// or gives it back unwritten
+static void flash_block_send_sector(flash_block_t* block, bool differs,
+    flash_eraser_t* eraser, flash_timing_t* timing)
+{
+    if (differs)
+    {
+        block->erase = FLASH_ERASE_SECTOR_SIZE;
+        flash_block_send(block, eraser, timing);
+        return;
+    }
+
+#ifdef FLASH_PIPELINE
+    xQueueSend(flash_free_queue, block, portMAX_DELAY);
+#endif
+
+    ++timing->skipped;
+    timing->skipped_bytes += block->count;
+}
+#endif
+
+static void flash_stream_progress(const char* writing, size_t offset, size_t length)
+{
+    printf("%s - %#08x\n", writing, (unsigned)offset);
+    DisplayProgress((float)offset / (float)(length - FLASH_BLOCK_SIZE) * 100.0f);
+    DisplayMessage(writing);
+}
+
+// Copies length bytes from file to flash at address, erasing first.
+// Data is added to checksum and part_checksum unless they are NULL.
+static void flash_stream(FILE* file, size_t address, size_t length,
+    const char* erasing, const char* writing, uint32_t* checksum, uint32_t* part_checksum,
+    void* data, flash_timing_t* timing)
+{
+    int64_t start = esp_timer_get_time();
+
+    if (length == 0) return;
+
+    // erasing goes on alongside the writes, which show the progress
+    printf("%s\n", erasing);
+
+#ifdef FLASH_PIPELINE
+    // the writer runs on core 1 while the reader runs on core 0. It sits
+    // below the display task, so progress updates still get through.
+    xTaskCreatePinnedToCore(&flash_writer_task, "flash_writer", 1024 * 3, timing,
+        4, NULL, 1);
+#endif
+    flash_eraser_t eraser = { 0, 0 };   // without the pipeline
+    flash_block_t block;
+
+    // turn LED on
+    gpio_set_level(GPIO_NUM_2, 1);
+
+#ifdef FLASH_DIFFERENTIAL
+    size_t offset = 0;
+    while (offset < length)
+    {
+        // the rest of the 64 KB erase block, or of the data
+        size_t group = FLASH_ERASE_BLOCK_SIZE - ((address + offset) & (FLASH_ERASE_BLOCK_SIZE - 1));
+        if (group > length - offset) group = length - offset;
+
+        // Only a whole block can be erased at once: hold its first sectors
+        // until they have been compared
+        flash_block_t ahead[FLASH_COMPARE_AHEAD];
+        bool ahead_differs[FLASH_COMPARE_AHEAD];
+        int ahead_count = 0;
+        int differ_count = 0;
+        size_t sector = 0;
+
+        if (group == FLASH_ERASE_BLOCK_SIZE)
+        {
+            for (; ahead_count < FLASH_COMPARE_AHEAD; ++ahead_count)
+            {
+                flash_stream_progress(writing, offset + sector, length);
+
+                flash_block_t* held = &ahead[ahead_count];
+                flash_block_take(held, data, timing);
+                flash_block_read(file, held, address + offset + sector, FLASH_ERASE_SECTOR_SIZE,
+                    checksum, part_checksum, timing);
+
+                ahead_differs[ahead_count] = !flash_block_matches(held, timing);
+                if (ahead_differs[ahead_count]) ++differ_count;
+
+                sector += FLASH_ERASE_SECTOR_SIZE;
+            }
+        }
+
+        bool erase_block = (ahead_count > 0 && differ_count == ahead_count);
+        for (int i = 0; i < ahead_count; ++i)
+        {
+            if (erase_block)
+            {
+                // the writer erases the block with the first sector, and
+                // the rest are written into it
+                if (i == 0) ahead[i].erase = FLASH_ERASE_BLOCK_SIZE;
+                flash_block_send(&ahead[i], &eraser, timing);
+            }
+            else
+            {
+                flash_block_send_sector(&ahead[i], ahead_differs[i], &eraser, timing);
+            }
+        }
+
+        for (; sector < group; sector += FLASH_ERASE_SECTOR_SIZE)
+        {
+            size_t count = (group - sector < FLASH_ERASE_SECTOR_SIZE) ? group - sector : FLASH_ERASE_SECTOR_SIZE;
+
+            flash_stream_progress(writing, offset + sector, length);
+
+            flash_block_take(&block, data, timing);
+            flash_block_read(file, &block, address + offset + sector, count,
+                checksum, part_checksum, timing);
+
+            if (erase_block)
+            {
+                flash_block_send(&block, &eraser, timing);
+            }
+            else
+            {
+                flash_block_send_sector(&block, !flash_block_matches(&block, timing), &eraser, timing);
+            }
+        }
+
+        offset += group;
+    }
+#else
+    size_t eraseBlocks = length / FLASH_BLOCK_SIZE;
+    if (eraseBlocks * FLASH_BLOCK_SIZE < length) ++eraseBlocks;
+
+    // give the writer the range to erase, so it can start erasing ahead
+    // while the first blocks are read
+    flash_block_take(&block, data, timing);
+    block.address = address;
+    block.erase = eraseBlocks * FLASH_BLOCK_SIZE;
+    flash_block_send(&block, &eraser, timing);
+
+    for (size_t offset = 0; offset < length; offset += FLASH_BLOCK_SIZE)
+    {
+        flash_stream_progress(writing, offset, length);
+
+        flash_block_take(&block, data, timing);
+        flash_block_read(file, &block, address + offset,
+            (length - offset < FLASH_BLOCK_SIZE) ? length - offset : FLASH_BLOCK_SIZE,
+            checksum, part_checksum, timing);
+        flash_block_send(&block, &eraser, timing);
+    }
+#endif
+
+#ifdef FLASH_PIPELINE
+    // an empty last block stops the writer once it has written the rest,
+    // then wait for it
+    flash_block_take(&block, data, timing);
+    block.last = true;
+    flash_block_send(&block, &eraser, timing);
+
+    const char* error;
+
+    int64_t timer = esp_timer_get_time();
+    xQueueReceive(flash_done_queue, &error, portMAX_DELAY);
+    timing->reader_wait += esp_timer_get_time() - timer;
+
+    if (error)
+    {
+        DisplayError(error);
+        indicate_error();
+    }
+#endif
+
+    timing->stream += esp_timer_get_time() - start;
+}
+
+// True when flash at address already holds length bytes with the CRC32 crc
+static bool flash_data_matches(size_t address, size_t length, uint32_t crc,
+    void* data, flash_timing_t* timing)
+{
+    uint32_t flash_crc = 0;
+    int64_t timer = esp_timer_get_time();
+
+    for (size_t offset = 0; offset < length; offset += FLASH_BLOCK_SIZE)
+    {
+        size_t block = (length - offset < FLASH_BLOCK_SIZE) ? length - offset : FLASH_BLOCK_SIZE;
+        if (spi_flash_read(address + offset, data, block) != ESP_OK)
+        {
+            return false;
+        }
+
+        flash_crc = crc32_le(flash_crc, data, block);
+    }
+
+    timing->compare += esp_timer_get_time() - timer;
+    return flash_crc == crc;
+}
+
 void flash_firmware(const char* fullPath)
 {
+    flash_timing_t timing;
+    int64_t timer;
     size_t count;
+    uint32_t checksum = 0;  // of the file up to where it has been read
 
     printf("%s: HEAP=%#010x\n", __func__, esp_get_free_heap_size());
 
@@ -448,7 +1223,11 @@ void flash_firmware(const char* fullPath)
         indicate_error();
     }
 
-    if (strncmp(HEADER_V00_01, header, headerLength) != 0)
+    checksum = crc32_le(checksum, (const uint8_t*)header, count);
+
+    // V00_02 has a header of the same length
+    bool hashed = (strncmp(HEADER_V00_02, header, headerLength) == 0);
+    if (!hashed && strncmp(HEADER_V00_01, header, headerLength) != 0)
     {
         DisplayError("HEADER MATCH ERROR");
         indicate_error();
@@ -465,6 +1244,8 @@ void flash_firmware(const char* fullPath)
         indicate_error();
     }
 
+    checksum = crc32_le(checksum, (const uint8_t*)FirmwareDescription, count);
+
     // ensure null terminated
     FirmwareDescription[FIRMWARE_DESCRIPTION_SIZE - 1] = 0;
 
@@ -487,6 +1268,8 @@ void flash_firmware(const char* fullPath)
         indicate_error();
     }
 
+    checksum = crc32_le(checksum, (const uint8_t*)tileData, count);
+
     const uint16_t tileLeft = (320 / 2) - (TILE_WIDTH / 2);
     const uint16_t tileTop = (16 + 16 + 16);
     ui_draw_image(tileLeft, tileTop,
@@ -495,9 +1278,55 @@ void flash_firmware(const char* fullPath)
     free(tileData);
 
     // Tile border
-    UG_DrawFrame(tileLeft - 1, tileTop - 1, tileLeft + TILE_WIDTH, tileTop + TILE_HEIGHT, C_BLACK);
+    ui_frame(tileLeft - 1, tileTop - 1, tileLeft + TILE_WIDTH, tileTop + TILE_HEIGHT, C_BLACK);
     UpdateDisplay();
 
+    const size_t PARTS_MAX = 20;
+
+    // Partition hashes
+    uint32_t hash_count = 0;
+    odroid_partition_hash_t* hashes = NULL;
+    if (hashed)
+    {
+        count = fread(&hash_count, 1, sizeof(hash_count), file);
+        if (count != sizeof(hash_count) || hash_count == 0 || hash_count > PARTS_MAX)
+        {
+            DisplayError("HASH TABLE READ ERROR");
+            indicate_error();
+        }
+
+        checksum = crc32_le(checksum, (const uint8_t*)&hash_count, count);
+
+        hashes = malloc(sizeof(odroid_partition_hash_t) * hash_count);
+        if (!hashes)
+        {
+            DisplayError("HASH TABLE MEMORY ERROR");
+            indicate_error();
+        }
+
+        count = fread(hashes, 1, sizeof(odroid_partition_hash_t) * hash_count, file);
+        if (count != sizeof(odroid_partition_hash_t) * hash_count)
+        {
+            DisplayError("HASH TABLE READ ERROR");
+            indicate_error();
+        }
+
+        checksum = crc32_le(checksum, (const uint8_t*)hashes, count);
+
+        // the table is checked before anything is written
+        uint32_t table_checksum;
+        count = fread(&table_checksum, 1, sizeof(table_checksum), file);
+        if (count != sizeof(table_checksum) || table_checksum != checksum)
+        {
+            printf("%s: table checksum=%#010x, expected=%#010x\n", __func__, checksum, table_checksum);
+
+            DisplayError("HASH TABLE CHECKSUM ERROR");
+            indicate_error();
+        }
+
+        checksum = crc32_le(checksum, (const uint8_t*)&table_checksum, count);
+    }
+
     // start to begin, b back
     DisplayMessage("[START]");
     DisplayFooter("[B] Cancel");
@@ -528,17 +1357,31 @@ void flash_firmware(const char* fullPath)
     //UpdateDisplay();
 
 
-    DisplayMessage("Verifying ...");
+#ifdef FLASH_SINGLE_PASS
+    const bool single_pass = true;
+#else
+    const bool single_pass = false;
+#endif
 
+    if (!single_pass) DisplayMessage("Verifying ...");
 
-    const int ERASE_BLOCK_SIZE = 4096;
-    void* data = malloc(ERASE_BLOCK_SIZE);
+    // Display work runs on the other core, so it overlaps the phases below
+    memset(&timing, 0, sizeof(timing));
+    timing.start = esp_timer_get_time();
+    ili9341_stats_reset();
+
+
+    void* data = malloc(FLASH_BLOCK_SIZE);
     if (!data)
     {
         DisplayError("DATA MEMORY ERROR");
         indicate_error();
     }
 
+#ifdef FLASH_PIPELINE
+    flash_pipeline_init();
+#endif
+
 
     // Verify file integerity
     size_t current_position = ftell(file);
@@ -558,31 +1401,36 @@ void flash_firmware(const char* fullPath)
     }
     printf("%s: expected_checksum=%#010x\n", __func__, expected_checksum);
 
-
-    fseek(file, 0, SEEK_SET);
-
-    uint32_t checksum = 0;
-    size_t check_offset = 0;
-    while(true)
+    if (!single_pass)
     {
-        count = fread(data, 1, ERASE_BLOCK_SIZE, file);
-        if (check_offset + count == file_size)
+        fseek(file, 0, SEEK_SET);
+
+        uint32_t file_checksum = 0;
+        size_t check_offset = 0;
+        while(true)
         {
-            count -= 4;
-        }
+            timer = esp_timer_get_time();
+            count = fread(data, 1, FLASH_BLOCK_SIZE, file);
+            timing.read += esp_timer_get_time() - timer;
 
-        checksum = crc32_le(checksum, data, count);
-        check_offset += count;
+            if (check_offset + count == file_size)
+            {
+                count -= 4;
+            }
 
-        if (count < ERASE_BLOCK_SIZE) break;
-    }
+            file_checksum = crc32_le(file_checksum, data, count);
+            check_offset += count;
 
-    printf("%s: checksum=%#010x\n", __func__, checksum);
+            if (count < FLASH_BLOCK_SIZE) break;
+        }
 
-    if (checksum != expected_checksum)
-    {
-        DisplayError("CHECKSUM MISMATCH ERROR");
-        indicate_error();
+        printf("%s: checksum=%#010x\n", __func__, file_checksum);
+
+        if (file_checksum != expected_checksum)
+        {
+            DisplayError("CHECKSUM MISMATCH ERROR");
+            indicate_error();
+        }
     }
 
     // restore location to end of description
@@ -606,8 +1454,8 @@ void flash_firmware(const char* fullPath)
     printf("%s: FLASH_START_ADDRESS=%#010x\n", __func__, FLASH_START_ADDRESS);
 
 
-    const size_t PARTS_MAX = 20;
     int parts_count = 0;
+    bool skipped = false;   // data stepped over, so not in the file CRC
     odroid_partition_t* parts = malloc(sizeof(odroid_partition_t) * PARTS_MAX);
     if (!parts)
     {
@@ -634,6 +1482,8 @@ void flash_firmware(const char* fullPath)
             indicate_error();
         }
 
+        checksum = crc32_le(checksum, (const uint8_t*)&slot, count);
+
         if (parts_count >= PARTS_MAX)
         {
             DisplayError("PARTITION COUNT ERROR");
@@ -668,6 +1518,8 @@ void flash_firmware(const char* fullPath)
             indicate_error();
         }
 
+        checksum = crc32_le(checksum, (const uint8_t*)&length, count);
+
         if (length > slot.length)
         {
             printf("%s: data length error - length=%x, slot.length=%x\n",
@@ -677,91 +1529,61 @@ void flash_firmware(const char* fullPath)
             indicate_error();
         }
 
-        size_t nextEntry = ftell(file) + length;
-
-        if (length > 0)
+        // the entry has to be the one the table was checked with
+        if (hashed && ((uint32_t)parts_count >= hash_count ||
+            memcmp(&hashes[parts_count].slot, &slot, sizeof(slot)) != 0 ||
+            hashes[parts_count].length != length))
         {
-            // turn LED off
-            gpio_set_level(GPIO_NUM_2, 0);
-
-
-            // erase
-            int eraseBlocks = length / ERASE_BLOCK_SIZE;
-            if (eraseBlocks * ERASE_BLOCK_SIZE < length) ++eraseBlocks;
-
-            // Display
-            sprintf(tempstring, "Erasing ... (%d)", parts_count);
-
-            printf("%s\n", tempstring);
-            DisplayProgress(0);
-            DisplayMessage(tempstring);
-
-            esp_err_t ret = spi_flash_erase_range(curren_flash_address, eraseBlocks * ERASE_BLOCK_SIZE);
-            if (ret != ESP_OK)
-            {
-                printf("spi_flash_erase_range failed. eraseBlocks=%d\n", eraseBlocks);
-                DisplayError("ERASE ERROR");
-                indicate_error();
-            }
-
-
-            // turn LED on
-            gpio_set_level(GPIO_NUM_2, 1);
+            DisplayError("HASH TABLE MISMATCH ERROR");
+            indicate_error();
+        }
 
+#ifdef FLASH_DIFFERENTIAL
+        // flash_stream compares each sector as it is read, so checking the
+        // whole partition first would read flash twice when it differs
+        const bool unchanged = false;
+#else
+        const bool unchanged = (length > 0 && hashed &&
+            flash_data_matches(curren_flash_address, length, hashes[parts_count].crc, data, &timing));
+#endif
 
-            // Write data
-            int totalCount = 0;
-            for (int offset = 0; offset < length; offset += ERASE_BLOCK_SIZE)
+        if (unchanged)
+        {
+            // already installed: step over the data. The table CRC and the
+            // partition's own CRC stand in for the file CRC, which can no
+            // longer be checked.
+            printf("Unchanged (%d)\n", parts_count);
+            fseek(file, length, SEEK_CUR);
+            skipped = true;
+        }
+        else if (length > 0)
+        {
+            char erasing[32];
+            sprintf(erasing, "Erasing ... (%d)", parts_count);
+            sprintf(tempstring, "Writing (%d)", parts_count);
+
+            // In a single pass the data also goes into the file CRC. V00_01
+            // files have no partition CRCs, so the CRC of the data as read
+            // is kept to check what is read back.
+            uint32_t part_checksum = 0;
+            flash_stream(file, curren_flash_address, length, erasing, tempstring,
+                single_pass ? &checksum : NULL, hashed ? NULL : &part_checksum, data, &timing);
+
+            // read the partition back from flash
+            uint32_t expected = hashed ? hashes[parts_count].crc : part_checksum;
+            if (!flash_data_matches(curren_flash_address, length, expected, data, &timing))
             {
-                // Display
-                sprintf(tempstring, "Writing (%d)", parts_count);
-
-                printf("%s - %#08x\n", tempstring, offset);
-                DisplayProgress((float)offset / (float)(length - ERASE_BLOCK_SIZE) * 100.0f);
-                DisplayMessage(tempstring);
-
-                // read
-                //printf("Reading offset=0x%x\n", offset);
-                count = fread(data, 1, ERASE_BLOCK_SIZE, file);
-                if (count <= 0)
-                {
-                    DisplayError("DATA READ ERROR");
-                    indicate_error();
-                }
-
-                if (offset + count >= length)
-                {
-                    count = length - offset;
-                }
-
-
-                // flash
-                //printf("Writing offset=0x%x\n", offset);
-                //ret = esp_partition_write(part, offset, data, count);
-                ret = spi_flash_write(curren_flash_address + offset, data, count);
-                if (ret != ESP_OK)
-        		{
-        			printf("spi_flash_write failed. address=%#08x\n", curren_flash_address + offset);
-                    DisplayError("WRITE ERROR");
-                    indicate_error();
-        		}
+                printf("%s: partition %d does not read back with checksum=%#010x\n", __func__,
+                    parts_count, expected);
 
-                totalCount += count;
-            }
+                // The old partition table is still in place, but what it
+                // points at has been written over: boot the menu from now on.
+                esp_ota_set_boot_partition(factory_part);
 
-            if (totalCount != length)
-            {
-                printf("Size mismatch: lenght=%#08x, totalCount=%#08x\n", length, totalCount);
-                DisplayError("DATA SIZE ERROR");
+                DisplayError("PARTITION VERIFY ERROR");
                 indicate_error();
             }
 
-
-            // TODO: verify
-
-
-
-
             // Notify OK
             sprintf(tempstring, "OK: [%d] Length=%#08x", parts_count, length);
 
@@ -771,18 +1593,31 @@ void flash_firmware(const char* fullPath)
 
         parts[parts_count++] = slot;
         curren_flash_address += slot.length;
+    }
+
+    close(file);
+
+    if (hashed && (uint32_t)parts_count != hash_count)
+    {
+        esp_ota_set_boot_partition(factory_part);
 
+        DisplayError("HASH TABLE MISMATCH ERROR");
+        indicate_error();
+    }
+
+    if (single_pass && !skipped)
+    {
+        printf("%s: checksum=%#010x\n", __func__, checksum);
 
-        // Seek to next entry
-        if (fseek(file, nextEntry, SEEK_SET) != 0)
+        if (checksum != expected_checksum)
         {
-            DisplayError("SEEK ERROR");
+            esp_ota_set_boot_partition(factory_part);
+
+            DisplayError("CHECKSUM MISMATCH ERROR");
             indicate_error();
         }
-
     }
 
-    close(file);
 
 
     // Utility
@@ -807,73 +1642,8 @@ void flash_firmware(const char* fullPath)
         // TODO: Determine if there is room
 
 
-        // turn LED off
-        gpio_set_level(GPIO_NUM_2, 0);
-
-
-        // Erase
-        int eraseBlocks = length / ERASE_BLOCK_SIZE;
-        if (eraseBlocks * ERASE_BLOCK_SIZE < length) ++eraseBlocks;
-
-        // Display
-        sprintf(tempstring, "Erasing Utility ...");
-
-        printf("%s\n", tempstring);
-        DisplayProgress(0);
-        DisplayMessage(tempstring);
-
-        esp_err_t ret = spi_flash_erase_range(curren_flash_address, eraseBlocks * ERASE_BLOCK_SIZE);
-        if (ret != ESP_OK)
-        {
-            printf("spi_flash_erase_range failed. eraseBlocks=%d\n", eraseBlocks);
-            DisplayError("ERASE ERROR");
-            indicate_error();
-        }
-
-
-        // turn LED on
-        gpio_set_level(GPIO_NUM_2, 1);
-
-
-        // Write data
-        int totalCount = 0;
-        for (int offset = 0; offset < length; offset += ERASE_BLOCK_SIZE)
-        {
-            // Display
-            sprintf(tempstring, "Writing Utility");
-
-            printf("%s - %#08x\n", tempstring, offset);
-            DisplayProgress((float)offset / (float)(length - ERASE_BLOCK_SIZE) * 100.0f);
-            DisplayMessage(tempstring);
-
-            // read
-            //printf("Reading offset=0x%x\n", offset);
-            count = fread(data, 1, ERASE_BLOCK_SIZE, util);
-            if (count <= 0)
-            {
-                DisplayError("DATA READ ERROR");
-                indicate_error();
-            }
-
-            if (offset + count >= length)
-            {
-                count = length - offset;
-            }
-
-
-            // flash
-            //printf("Writing offset=0x%x\n", offset);
-            //ret = esp_partition_write(part, offset, data, count);
-            ret = spi_flash_write(curren_flash_address + offset, data, count);
-            if (ret != ESP_OK)
-            {
-                printf("spi_flash_write failed. address=%#08x\n", curren_flash_address + offset);
-                DisplayError("WRITE ERROR");
-                indicate_error();
-            }
-
-            totalCount += count;
-        }
+        flash_stream(util, curren_flash_address, length, "Erasing Utility ...", "Writing Utility",
+            NULL, NULL, data, &timing);
 
         // Add partition
         odroid_partition_t util_part;
@@ -901,8 +1671,14 @@ void flash_firmware(const char* fullPath)
     // Write partition table
     write_partition_table(parts, parts_count);
 
+    flash_report_timing(&timing);
+
 
     free(data);
+    free(hashes);
+#ifdef FLASH_PIPELINE
+    flash_pipeline_free();
+#endif
 
     // Close SD card
     odroid_sdcard_close();
@@ -911,6 +1687,7 @@ void flash_firmware(const char* fullPath)
     gpio_set_level(GPIO_NUM_2, 0);
 
     // clear framebuffer
+    ui_wait_display();
     ili9341_clear(0x0000);
 
     // boot firmware
@@ -921,36 +1698,156 @@ void flash_firmware(const char* fullPath)
 
 
 
+// Redraw only what changed when the selection moves: within a page just the
+// two affected rows (the tiles stay in fb), and on a page change only the
+// list rows. Comment out to redraw the whole screen on every move.
+#define UI_LIST_INCREMENTAL
+
+// Page and item on screen; -1 after anything else drew over the list
+static int ui_list_page = -1;
+static int ui_list_item = -1;
+
+// Keep the labels of the rows on the page rendered off-screen, plain and
+// selected, so a selection move composites two blocks instead of drawing
+// text. The band renderer has no framebuffer to composite into.
+#define UI_LIST_LABEL_CACHE
+
+#if defined(UI_BAND_RENDERER) || !defined(UI_LIST_INCREMENTAL)
+#undef UI_LIST_LABEL_CACHE
+#endif
+
+#ifdef UI_LIST_LABEL_CACHE
+#define UI_LABEL_WIDTH (213)    // from the text to the right edge
+#define UI_LABEL_LINES_MAX (2)  // as much as fits under the text in a row
+
+// Draws into the labels. Set up for the widest label, so names wrap
+// where they would on screen.
+static UG_GUI ui_label_gui;
+static UG_SURFACE ui_label_template;
+
+// Indexed by line and selected; p is NULL when not rendered yet
+static UG_SURFACE ui_labels[ITEM_COUNT][2];
+
+static void ui_label_cache_clear()
+{
+    for (int line = 0; line < ITEM_COUNT; ++line)
+    {
+        for (int selected = 0; selected < 2; ++selected)
+        {
+            free(ui_labels[line][selected].p);
+            ui_labels[line][selected].p = NULL;
+        }
+    }
+}
+
+// The size UG_PutString needs for text in a label
+static void ui_label_measure(const char* text, short* width, short* height)
+{
+    const UG_FONT* font = &FONT_8X12;
+    short x = 0;
+    short right = 0;
+    short lines = 1;
+
+    for (const char* c = text; *c; ++c)
+    {
+        if (*c < font->start_char || *c > font->end_char) continue;
+
+        short cw = font->widths ? font->widths[*c - font->start_char] : font->char_width;
+        if (x + cw > UI_LABEL_WIDTH - 1)
+        {
+            x = 0;
+            ++lines;
+        }
+
+        x += cw;
+        if (x > right) right = x;
+        x += ui_label_gui.char_h_space;
+    }
+
+    if (lines > UI_LABEL_LINES_MAX) lines = UI_LABEL_LINES_MAX;
+
+    *width = (right > 0) ? right : 1;
+    *height = lines * (font->char_height + ui_label_gui.char_v_space) - ui_label_gui.char_v_space;
+}
+
+// Draw a label at (x, y), rendering it first if it is not cached
+static void ui_label_draw(int line, bool selected, short x, short y, const char* text)
+{
+    UG_SURFACE* label = &ui_labels[line][selected];
+    UG_COLOR color = selected ? C_YELLOW : C_WHITE;
+
+    if (!ui_label_gui.surface)
+    {
+        ui_label_template.width = UI_LABEL_WIDTH;
+        ui_label_template.height = UI_LABEL_LINES_MAX * (12 + 1) - 1;
+        UG_SurfaceInit(&ui_label_gui, &ui_label_template);
+        UG_SelectGUI(&gui);
+    }
+
+    if (!label->p)
+    {
+        short width, height;
+        ui_label_measure(text, &width, &height);
+
+        label->p = malloc(width * height * sizeof(uint16_t));
+        if (!label->p)
+        {
+            // Draw it directly instead
+            ui_font(&FONT_8X12);
+            ui_string(x, y, text);
+            return;
+        }
+
+        label->width = width;
+        label->height = height;
+        label->stride = width;
+        label->format = SURFACE_FORMAT_COLOR;
+
+        UG_SurfaceSet(&ui_label_gui, label);
+        UG_SelectGUI(&ui_label_gui);
+        UG_FontSelect(&FONT_8X12);
+        UG_SetForecolor(C_BLACK);
+        UG_SetBackcolor(color);
+        UG_FillFrame(0, 0, width - 1, height - 1, color);
+        UG_PutString(0, 0, (char*)text);
+        UG_SelectGUI(&gui);
+    }
+
+    UG_SurfaceBlit(label, 0, 0, label->width, label->height, x, y);
+}
+#endif
+
 static void ui_draw_title()
 {
     const char* TITLE = "ODROID-GO";
 
-    UG_FillFrame(0, 0, 319, 239, C_WHITE);
+    ui_list_page = -1;
+    ui_list_item = -1;
+#ifdef UI_LIST_LABEL_CACHE
+    ui_label_cache_clear();
+#endif
+
+    ui_fill(0, 0, 319, 239, C_WHITE);
 
     // Header
-    UG_FillFrame(0, 0, 319, 15, C_MIDNIGHT_BLUE);
-    UG_FontSelect(&FONT_8X8);
+    ui_fill(0, 0, 319, 15, C_MIDNIGHT_BLUE);
+    ui_font(&FONT_8X8);
     const short titleLeft = (320 / 2) - (strlen(TITLE) * 9 / 2);
-    UG_SetForecolor(C_WHITE);
-    UG_SetBackcolor(C_MIDNIGHT_BLUE);
-    UG_PutString(titleLeft, 4, TITLE);
+    ui_forecolor(C_WHITE);
+    ui_backcolor(C_MIDNIGHT_BLUE);
+    ui_string(titleLeft, 4, TITLE);
 
     // Footer
-    UG_FillFrame(0, 239 - 16, 319, 239, C_MIDNIGHT_BLUE);
+    ui_fill(0, 239 - 16, 319, 239, C_MIDNIGHT_BLUE);
     const short footerLeft = (320 / 2) - (strlen(VERSION) * 9 / 2);
-    UG_SetForecolor(C_DARK_GRAY);
-    UG_PutString(footerLeft, 240 - 4 - 8, VERSION);
+    ui_forecolor(C_DARK_GRAY);
+    ui_string(footerLeft, 240 - 4 - 8, VERSION);
 }
 
-static void ui_draw_page(char** files, int fileCount, int currentItem)
+// Draw row line of the list with file index. tile is NULL to keep the tile
+// already in fb and only repaint around it.
+static void ui_draw_item(char** files, int fileCount, int line, int index, bool selected, uint16_t* tile)
 {
-    printf("%s: HEAP=%#010x\n", __func__, esp_get_free_heap_size());
-
-    int page = currentItem / ITEM_COUNT;
-    page *= ITEM_COUNT;
-
-    ui_draw_title();
-
     const int innerHeight = 240 - (16 * 2); // 208
     const int itemHeight = innerHeight / ITEM_COUNT; // 52
 
@@ -961,6 +1858,96 @@ static void ui_draw_page(char** files, int fileCount, int currentItem)
     const short imageLeft = (leftWidth / 2) - (86 / 2);
     const short textLeft = 320 - rightWidth;
 
+    short top = 16 + (line * itemHeight) - 1;
+    short bottom = top + itemHeight - 1 - 1;
+    UG_COLOR color = selected ? C_YELLOW : C_WHITE;
+
+    if (index >= fileCount)
+    {
+        ui_fill(0, top + 2, 319, bottom, C_WHITE);
+        return;
+    }
+
+    ui_forecolor(C_BLACK);
+    ui_backcolor(color);
+
+    if (tile)
+    {
+        ui_fill(0, top + 2, 319, bottom, color);
+    }
+    else
+    {
+        ui_fill(0, top + 2, imageLeft - 1, bottom, color);
+        ui_fill(imageLeft + TILE_WIDTH, top + 2, 319, bottom, color);
+        ui_fill(imageLeft, top + 2 + TILE_HEIGHT, imageLeft + TILE_WIDTH - 1, bottom, color);
+    }
+
+    char* fileName = files[index];
+    if (!fileName) abort();
+
+    if (tile)
+    {
+        size_t fullPathLength = strlen(path) + 1 + strlen(fileName) + 1;
+        char* fullPath = (char*)malloc(fullPathLength);
+        if (!fullPath) abort();
+
+        strcpy(fullPath, path);
+        strcat(fullPath, "/");
+        strcat(fullPath, fileName);
+        ui_firmware_image_get(fullPath, tile);
+        ui_draw_image(imageLeft, top + 2, TILE_WIDTH, TILE_HEIGHT, tile);
+
+        free(fullPath);
+
+        // Tile border
+        //ui_frame(imageLeft - 1, top + 1, imageLeft + TILE_WIDTH, top + 2 + TILE_HEIGHT, C_BLACK);
+    }
+
+    char* displayString = (char*)malloc(strlen(fileName) + 1);
+    if (!displayString) abort();
+
+    strcpy(displayString, fileName);
+    displayString[strlen(fileName) - 3] = 0; // ".fw" = 3
+
+#ifdef UI_LIST_LABEL_CACHE
+    ui_label_draw(line, selected, textLeft, top + 2 + 2 + 16, displayString);
+#else
+    ui_font(&FONT_8X12);
+    ui_string(textLeft, top + 2 + 2 + 16, displayString);
+#endif
+
+    free(displayString);
+}
+
+static void ui_draw_page(char** files, int fileCount, int currentItem)
+{
+    printf("%s: HEAP=%#010x\n", __func__, esp_get_free_heap_size());
+
+    int page = currentItem / ITEM_COUNT;
+    page *= ITEM_COUNT;
+
+#ifdef UI_LIST_INCREMENTAL
+    if (page == ui_list_page)
+    {
+        if (currentItem != ui_list_item)
+        {
+            ui_draw_item(files, fileCount, ui_list_item - page, ui_list_item, false, NULL);
+            ui_draw_item(files, fileCount, currentItem - page, currentItem, true, NULL);
+        }
+
+        ui_list_item = currentItem;
+        ui_update_display();
+        return;
+    }
+
+    // The header and footer are still on screen from the previous page
+    if (ui_list_page < 0)
+    {
+        ui_draw_title();
+    }
+#else
+    ui_draw_title();
+#endif
 
 	if (fileCount < 1)
 	{
@@ -976,68 +1963,21 @@ static void ui_draw_page(char** files, int fileCount, int currentItem)
         uint16_t* tile = malloc(TILE_LENGTH);
         if (!tile) abort();
 
-        char* displayStrings[ITEM_COUNT];
-        for(int i = 0; i < ITEM_COUNT; ++i)
-        {
-            displayStrings[i] = NULL;
-        }
+#ifdef UI_LIST_LABEL_CACHE
+        ui_label_cache_clear();
+#endif
 
 	    for (int line = 0; line < ITEM_COUNT; ++line)
 	    {
-			if (page + line >= fileCount) break;
-
-            //uint16_t id = TXB_ID_0 + line;
-            short top = 16 + (line * itemHeight) - 1;
-
-	        if ((page) + line == currentItem)
-	        {
-                UG_SetForecolor(C_BLACK);
-                UG_SetBackcolor(C_YELLOW);
-                UG_FillFrame(0, top + 2, 319, top + itemHeight - 1 - 1, C_YELLOW);
-	        }
-	        else
-	        {
-                UG_SetForecolor(C_BLACK);
-                UG_SetBackcolor(C_WHITE);
-                UG_FillFrame(0, top + 2, 319, top + itemHeight - 1 - 1, C_WHITE);
-	        }
-
-			char* fileName = files[page + line];
-			if (!fileName) abort();
-
-			displayStrings[line] = (char*)malloc(strlen(fileName) + 1);
-            strcpy(displayStrings[line], fileName);
-            displayStrings[line][strlen(fileName) - 3] = 0; // ".fw" = 3
-
-
-            size_t fullPathLength = strlen(path) + 1 + strlen(fileName) + 1;
-            char* fullPath = (char*)malloc(fullPathLength);
-            if (!fullPath) abort();
-
-            strcpy(fullPath, path);
-            strcat(fullPath, "/");
-            strcat(fullPath, fileName);
-            ui_firmware_image_get(fullPath, tile);
-            ui_draw_image(imageLeft, top + 2, TILE_WIDTH, TILE_HEIGHT, tile);
-
-            free(fullPath);
-
-            // Tile border
-            //UG_DrawFrame(imageLeft - 1, top + 1, imageLeft + TILE_WIDTH, top + 2 + TILE_HEIGHT, C_BLACK);
-
-	        //UG_TextboxSetText(&window1, id, displayStrings[line]);
-            UG_FontSelect(&FONT_8X12);
-            UG_PutString(textLeft, top + 2 + 2 + 16, displayStrings[line]);
+            ui_draw_item(files, fileCount, line, page + line, (page + line) == currentItem, tile);
 	    }
 
         ui_update_display();
 
-        for(int i = 0; i < ITEM_COUNT; ++i)
-        {
-            free(displayStrings[i]);
-        }
-
         free(tile);
+
+        ui_list_page = page;
+        ui_list_item = currentItem;
 	}
 }
 
@@ -1241,7 +2181,7 @@ void app_main(void)
     ili9341_init();
     ili9341_clear(0xffff);
 
-    UG_Init(&gui, pset, 320, 240);
+    ui_init();
 
     menu_main();
 
@@ -4,10 +4,12 @@
 #include "driver/spi_master.h"
 #include "driver/ledc.h"
 #include "driver/rtc_io.h"
+#include "esp_timer.h"
 
 #include <string.h>
 
 #include "odroid_display.h"
+#include "rgb565.h"
 
 
 const gpio_num_t SPI_PIN_NUM_MISO = GPIO_NUM_19;
@@ -35,16 +37,38 @@ const int LCD_SPI_CLOCK_RATE = 40000000;
 #define TFT_RGB_BGR 0x08
 
 
-static spi_transaction_t trans[8];
+// Transactions are queued through a ring of slots, one per entry of the
+// device queue. Every queued transaction gets a sequence number; the post
+// callback publishes the last one that finished, so a buffer can be reused as
+// soon as the transaction that reads it is done, without waiting on anything
+// queued after it.
+#define TRANS_RING_SIZE (7)
+
+static spi_transaction_t trans_ring[TRANS_RING_SIZE];
+static uint32_t trans_ring_seq[TRANS_RING_SIZE]; // 0 when the slot is free
+static short trans_ring_head = 0;   // next slot to queue
+static short trans_ring_tail = 0;   // oldest slot whose result was not fetched
+static short trans_ring_used = 0;
+static uint32_t trans_seq = 0;                 // last sequence number queued
+static volatile uint32_t trans_completed = 0;  // last sequence number sent
+static ili9341_stats_t stats;
 static spi_device_handle_t spi;
-//static volatile short freeTransactionCount = 6;
-static TaskHandle_t xTaskToNotify = NULL;
-//static bool useCallbacks = false;
 
 
 #define LINE_COUNT (6)
 //uint16_t* line[2]; //[320 * LINE_COUNT]; // Must be at least 320
-static uint16_t line[2][320 * LINE_COUNT]; // Must be at least 320
+static uint16_t line[2][320 * LINE_COUNT] __attribute__((aligned(4))); // Must be at least 320
+static uint32_t line_seq[2]; // last transaction reading each line buffer
+
+// Solid color fills send this buffer over and over into a single window.
+#define FILL_PIXELS (320 * 16)
+static uint16_t fill_buffer[FILL_PIXELS] __attribute__((aligned(4)));
+static uint16_t fill_color;   // panel byte order
+static bool fill_valid = false;
+static uint32_t fill_seq;     // last transaction reading fill_buffer
+
+// Largest single data transaction, in bytes (48 full lines)
+#define SPI_MAX_TRANSFER (320 * 48 * 2)
 
 const int DUTY_MAX = 0x1fff;
 
@@ -125,6 +149,8 @@ static void ili_cmd(spi_device_handle_t spi, const uint8_t cmd)
     t.tx_buffer=&cmd;               //The data is the cmd itself
     t.user=(void*)0;                //D/C needs to be set to 0
     ret=spi_device_transmit(spi, &t);  //Transmit!
+    ++stats.transactions;
+    ++stats.bytes;
     assert(ret==ESP_OK);            //Should have had no issues.
 }
 
@@ -139,6 +165,8 @@ static void ili_data(spi_device_handle_t spi, const uint8_t *data, int len)
     t.tx_buffer=data;               //Data
     t.user=(void*)1;                //D/C needs to be set to 1
     ret=spi_device_transmit(spi, &t);  //Transmit!
+    ++stats.transactions;
+    stats.bytes += len;
     assert(ret==ESP_OK);            //Should have had no issues.
 }
 
@@ -146,21 +174,17 @@ static void ili_data(spi_device_handle_t spi, const uint8_t *data, int len)
 //set the D/C line to the value indicated in the user field.
 static void ili_spi_pre_transfer_callback(spi_transaction_t *t)
 {
-    int dc=(int)t->user;
+    int dc=(int)(intptr_t)t->user;
     gpio_set_level(LCD_PIN_NUM_DC, dc);
 }
 
+//This function is called (in irq context!) when a transmission is done. Transactions finish
+//in queue order, so the newest sequence number covers everything queued before it.
 static void ili_spi_post_transfer_callback(spi_transaction_t *t)
 {
-    if(xTaskToNotify && t == &trans[7])
+    if (t >= &trans_ring[0] && t < &trans_ring[TRANS_RING_SIZE])
     {
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-
-        /* Notify the task that the transmission is complete. */
-        vTaskNotifyGiveFromISR(xTaskToNotify, &xHigherPriorityTaskWoken );
-
-        if (xHigherPriorityTaskWoken)
-            portYIELD_FROM_ISR();
+        trans_completed = trans_ring_seq[t - trans_ring];
     }
 }
 
@@ -186,61 +210,169 @@ static void ili_init()
     }
 }
 
-static void send_reset_drawing(int left, int top, int width, int height)
+// Fetch the result of the oldest queued transaction and free its slot.
+static void trans_ring_reap()
 {
   esp_err_t ret;
+  spi_transaction_t *rtrans;
 
-  trans[0].tx_data[0]=0x2A;           //Column Address Set
-  trans[1].tx_data[0]=(left) >> 8;              //Start Col High
-  trans[1].tx_data[1]=(left) & 0xff;              //Start Col Low
-  trans[1].tx_data[2]=(left + width - 1) >> 8;       //End Col High
-  trans[1].tx_data[3]=(left + width - 1) & 0xff;     //End Col Low
-  trans[2].tx_data[0]=0x2B;           //Page address set
-  trans[3].tx_data[0]=top >> 8;        //Start page high
-  trans[3].tx_data[1]=top & 0xff;      //start page low
-  trans[3].tx_data[2]=(top + height - 1)>>8;    //end page high
-  trans[3].tx_data[3]=(top + height - 1)&0xff;  //end page low
-  trans[4].tx_data[0]=0x2C;           //memory write
-
-  // Queue all transactions.
-  for (int x = 0; x < 5; x++) {
-      ret=spi_device_queue_trans(spi, &trans[x], 1000 / portTICK_RATE_MS);
-      assert(ret==ESP_OK);
-  }
+  int64_t start = esp_timer_get_time();
+  ret=spi_device_get_trans_result(spi, &rtrans, portMAX_DELAY);
+  stats.wait_us += esp_timer_get_time() - start;
+  assert(ret==ESP_OK);
+  assert(rtrans == &trans_ring[trans_ring_tail]);
 
-  // Wait for all transactions
-  spi_transaction_t *rtrans;
-  for (int x = 0; x < 5; x++) {
-      ret=spi_device_get_trans_result(spi, &rtrans, 1000 / portTICK_RATE_MS);
-      assert(ret==ESP_OK);
+  trans_ring_seq[trans_ring_tail] = 0;
+  ++trans_ring_tail;
+  if (trans_ring_tail >= TRANS_RING_SIZE) trans_ring_tail = 0;
+  --trans_ring_used;
+}
+
+// Take the next free slot, reaping the oldest result if the ring is full.
+static spi_transaction_t* trans_ring_acquire(int dc)
+{
+  if (trans_ring_used >= TRANS_RING_SIZE)
+  {
+      trans_ring_reap();
   }
+
+  spi_transaction_t* t = &trans_ring[trans_ring_head];
+  memset(t, 0, sizeof(*t));
+  t->user=(void*)(intptr_t)dc;
+
+  return t;
 }
 
-static void send_continue_line(uint16_t *line, int width, int lineCount)
+// Queue the slot taken by trans_ring_acquire. Returns its sequence number.
+static uint32_t trans_ring_submit(spi_transaction_t* t)
 {
   esp_err_t ret;
 
-  trans[6].tx_data[0] = 0x3C;           //memory write continue
-  trans[6].length = 8;            //Data length, in bits
-  trans[6].flags = SPI_TRANS_USE_TXDATA;
-  trans[6].rxlength = 0;
+  if (++trans_seq == 0) ++trans_seq; // 0 marks a free slot
+  trans_ring_seq[trans_ring_head] = trans_seq;
 
-  trans[7].tx_buffer=line;            //finally send the line data
-  trans[7].length= width * lineCount * 2 * 8;            //Data length, in bits
-  trans[7].flags=0; //undo SPI_TRANS_USE_TXDATA flag
-  trans[7].rxlength = 0;
+  ret=spi_device_queue_trans(spi, t, 1000 / portTICK_RATE_MS);
+  assert(ret==ESP_OK);
 
-  //Queue all transactions.
-  for (int x = 6; x < 8; x++) {
-      ret=spi_device_queue_trans(spi, &trans[x], 1000 / portTICK_RATE_MS);
-      assert(ret==ESP_OK);
+  ++trans_ring_head;
+  if (trans_ring_head >= TRANS_RING_SIZE) trans_ring_head = 0;
+  ++trans_ring_used;
+  ++stats.transactions;
+  stats.bytes += t->length / 8;
+
+  return trans_seq;
+}
+
+// Wait until the transaction with sequence number seq has been sent.
+static void trans_ring_wait(uint32_t seq)
+{
+  while (trans_ring_used > 0 && (int32_t)(trans_completed - seq) < 0)
+  {
+      trans_ring_reap();
   }
+}
 
-  // Wait for all transactions
-  spi_transaction_t *rtrans;
-  for (int x = 0; x < 2; x++) {
-      ret=spi_device_get_trans_result(spi, &rtrans, portMAX_DELAY);
-      assert(ret==ESP_OK);
+// Wait for everything queued and fetch all the results.
+static void trans_ring_wait_all()
+{
+  while (trans_ring_used > 0)
+  {
+      trans_ring_reap();
+  }
+}
+
+// Queue up to 4 bytes, copied into the transaction itself.
+static uint32_t send_bytes(int dc, const uint8_t* data, int len)
+{
+  spi_transaction_t* t = trans_ring_acquire(dc);
+
+  t->flags=SPI_TRANS_USE_TXDATA;
+  t->length=len * 8;
+  memcpy(t->tx_data, data, len);
+
+  return trans_ring_submit(t);
+}
+
+// Queue length bytes of pixel data. data must stay untouched until the
+// returned sequence number has been waited on.
+static uint32_t send_buffer(const void* data, size_t length)
+{
+  spi_transaction_t* t = trans_ring_acquire(1);
+
+  t->tx_buffer=data;
+  t->length=length * 8;            //Data length, in bits
+
+  return trans_ring_submit(t);
+}
+
+// The window commands go into the ring behind whatever is still being sent;
+// nothing needs to wait for them.
+static void send_reset_drawing(int left, int top, int width, int height)
+{
+  uint8_t data[4];
+
+  data[0]=0x2A;                         //Column Address Set
+  send_bytes(0, data, 1);
+
+  data[0]=(left) >> 8;                  //Start Col High
+  data[1]=(left) & 0xff;                //Start Col Low
+  data[2]=(left + width - 1) >> 8;      //End Col High
+  data[3]=(left + width - 1) & 0xff;    //End Col Low
+  send_bytes(1, data, 4);
+
+  data[0]=0x2B;                         //Page address set
+  send_bytes(0, data, 1);
+
+  data[0]=top >> 8;                     //Start page high
+  data[1]=top & 0xff;                   //start page low
+  data[2]=(top + height - 1)>>8;        //end page high
+  data[3]=(top + height - 1)&0xff;      //end page low
+  send_bytes(1, data, 4);
+
+  data[0]=0x2C;                         //memory write
+  send_bytes(0, data, 1);
+}
+
+// After send_reset_drawing the panel keeps accepting pixels for the open
+// window, so the pixel data is streamed as plain data transactions.
+
+// Stream pixels straight from a word aligned buffer in SPI_MAX_TRANSFER chunks.
+static void send_stream_buffer(const uint16_t* data, size_t pixels)
+{
+  while (pixels > 0)
+  {
+      size_t count = pixels;
+      if (count > SPI_MAX_TRANSFER / 2) count = SPI_MAX_TRANSFER / 2;
+
+      send_buffer(data, count * 2);
+
+      data += count;
+      pixels -= count;
+  }
+}
+
+// Stream pixels of a single color (panel byte order) out of fill_buffer.
+// The buffer is only rewritten when the color changes.
+static void send_stream_color(uint16_t color, size_t pixels)
+{
+  if (!fill_valid || fill_color != color)
+  {
+      trans_ring_wait(fill_seq);
+
+      rgb565_fill(fill_buffer, color, FILL_PIXELS);
+
+      fill_color = color;
+      fill_valid = true;
+  }
+
+  while (pixels > 0)
+  {
+      size_t count = pixels;
+      if (count > FILL_PIXELS) count = FILL_PIXELS;
+
+      fill_seq = send_buffer(fill_buffer, count * 2);
+
+      pixels -= count;
   }
 }
 
@@ -304,144 +436,240 @@ void backlight_deinit()
 
 void ili9341_write_frame(uint16_t* buffer)
 {
-    short x, y;
-
     if (buffer == NULL)
     {
-        // clear the buffer
-        memset(line[0], 0x00, 320 * sizeof(uint16_t));
-
-        // clear the screen
-        send_reset_drawing(0, 0, 320, 240);
-
-        for (y = 0; y < 240; ++y)
-        {
-            send_continue_line(line[0], 320, 1);
-        }
+        ili9341_clear(0x0000);
     }
     else
     {
-        const int displayWidth = 320;
-        const int displayHeight = 240;
-
-
-        send_reset_drawing(0, 0, displayWidth, displayHeight);
-
-        for (y = 0; y < displayHeight; y += 4)
-        {
-            send_continue_line(buffer + y * displayWidth, displayWidth, 4);
-        }
+        ili9341_write_frame_rectangle_stride(0, 0, 320, 240, 320, buffer);
     }
 }
 
 void ili9341_write_frame_rectangle(short left, short top, short width, short height, uint16_t* buffer)
 {
-    short x, y;
+    ili9341_write_frame_rectangle_stride(left, top, width, height, width, buffer);
+}
+
+void ili9341_write_frame_rectangle_stride(short left, short top, short width, short height, short stride, uint16_t* buffer)
+{
+    short y;
+    int64_t start = esp_timer_get_time();
 
     if (left < 0 || top < 0) abort();
     if (width < 1 || height < 1) abort();
+    if (width > 320 || stride < width) abort();
 
     send_reset_drawing(left, top, width, height);
 
     if (buffer == NULL)
     {
-        // clear the buffer
-        memset(line[0], 0x00, 320 * sizeof(uint16_t));
-
-        // clear the screen
-        for (y = 0; y < height; ++y)
-        {
-            send_continue_line(line[0], width, 1);
-        }
+        send_stream_color(0x0000, width * height);
+    }
+    else if (stride == width && ((uintptr_t)buffer & 3) == 0)
+    {
+        // The buffer is already in panel byte order and contiguous, so DMA
+        // straight out of it.
+        send_stream_buffer(buffer, width * height);
     }
     else
     {
+        // Gather bands of rows into a line buffer while the other one is
+        // on the wire. DMA also needs word aligned buffers.
+        const short bandHeight = (320 * LINE_COUNT) / width;
+
         short alt = 0;
-        for (y = 0; y < height; y++)
+        for (y = 0; y < height; y += bandHeight)
         {
-            memcpy(line[alt], buffer + y * width, width * sizeof(uint16_t));
-            send_continue_line(line[alt], width, 1);
+            short lineCount = height - y;
+            if (lineCount > bandHeight) lineCount = bandHeight;
+
+            trans_ring_wait(line_seq[alt]);
+
+            uint16_t* dst = line[alt];
+            for (short j = 0; j < lineCount; ++j)
+            {
+                memcpy(dst, buffer + (y + j) * stride, width * sizeof(uint16_t));
+                dst += width;
+            }
+
+            line_seq[alt] = send_buffer(line[alt], width * lineCount * 2);
 
             ++alt;
             if (alt > 1) alt = 0;
         }
     }
+
+    trans_ring_wait_all();
+
+    ++stats.write_calls;
+    stats.write_us += esp_timer_get_time() - start;
 }
 
-void ili9341_clear(uint16_t color)
+void ili9341_fill_rect(short left, short top, short width, short height, uint16_t color)
 {
-    send_reset_drawing(0, 0, 320, 240);
+    if (left < 0 || top < 0) abort();
+    if (width < 1 || height < 1) abort();
+    if (left + width > 320 || top + height > 240) abort();
 
-    // clear the buffer
-    for (int i = 0; i < 320; ++i)
-    {
-        line[0][i] = color;
-    }
+    int64_t start = esp_timer_get_time();
 
-    // clear the screen
-    for (int y = 0; y < 240; ++y)
-    {
-        send_continue_line(line[0], 320, 1);
-    }
+    send_reset_drawing(left, top, width, height);
+    send_stream_color((color << 8) | (color >> 8), width * height);
+
+    trans_ring_wait_all();
+
+    ++stats.fill_calls;
+    stats.fill_us += esp_timer_get_time() - start;
+}
+
+void ili9341_clear(uint16_t color)
+{
+    ili9341_fill_rect(0, 0, 320, 240, color);
 }
 
 void ili9341_write_frame_rectangleLE(short left, short top, short width, short height, uint16_t* buffer)
 {
-    short x, y;
+    ili9341_write_frame_rectangleLE_stride(left, top, width, height, width, buffer);
+}
+
+void ili9341_write_frame_rectangleLE_stride(short left, short top, short width, short height, short stride, uint16_t* buffer)
+{
+    short y;
+    int64_t start = esp_timer_get_time();
 
     if (left < 0 || top < 0) abort();
     if (width < 1 || height < 1) abort();
+    if (width > 320 || stride < width) abort();
 
     send_reset_drawing(left, top, width, height);
 
     if (buffer == NULL)
     {
-        // clear the buffer
-        memset(line[0], 0x00, 320 * sizeof(uint16_t));
-
-        // clear the screen
-        for (y = 0; y < height; ++y)
-        {
-            send_continue_line(line[0], width, 1);
-        }
+        send_stream_color(0x0000, width * height);
     }
     else
     {
+        // Swap a band into one buffer while the other one is on the wire.
+        const short bandHeight = (320 * LINE_COUNT) / width;
+
         short alt = 0;
-        for (y = 0; y < height; y++)
+        for (y = 0; y < height; y += bandHeight)
         {
-            //memcpy(line[alt], buffer + y * width, width * sizeof(uint16_t));
-            for (int i = 0; i < width; ++i)
+            short lineCount = height - y;
+            if (lineCount > bandHeight) lineCount = bandHeight;
+
+            trans_ring_wait(line_seq[alt]);
+
+            uint16_t* dst = line[alt];
+            for (short j = 0; j < lineCount; ++j)
             {
-                uint16_t pixel = buffer[y * width + i];
-                line[alt][i] = pixel << 8 | pixel >> 8;
+                rgb565_swap_copy(dst, buffer + (y + j) * stride, width);
+                dst += width;
             }
 
-            send_continue_line(line[alt], width, 1);
+            line_seq[alt] = send_buffer(line[alt], width * lineCount * 2);
 
             ++alt;
             if (alt > 1) alt = 0;
         }
     }
+
+    trans_ring_wait_all();
+
+    ++stats.write_calls;
+    stats.write_us += esp_timer_get_time() - start;
 }
 
-void ili9341_init()
+void ili9341_write_frame_rectangle_lines(short left, short top, short width, short height, ili9341_line_fn line_fn, void* arg)
 {
-	// Initialize transactions
-    for (int x=0; x<8; x++) {
-        memset(&trans[x], 0, sizeof(spi_transaction_t));
-        if ((x&1)==0) {
-            //Even transfers are commands
-            trans[x].length=8;
-            trans[x].user=(void*)0;
-        } else {
-            //Odd transfers are data
-            trans[x].length=8*4;
-            trans[x].user=(void*)1;
+    short y;
+    int64_t start = esp_timer_get_time();
+
+    if (left < 0 || top < 0) abort();
+    if (width < 1 || height < 1) abort();
+    if (width > 320 || !line_fn) abort();
+
+    send_reset_drawing(left, top, width, height);
+
+    // Produce a band into one buffer while the other one is on the wire.
+    const short bandHeight = (320 * LINE_COUNT) / width;
+
+    short alt = 0;
+    for (y = 0; y < height; y += bandHeight)
+    {
+        short lineCount = height - y;
+        if (lineCount > bandHeight) lineCount = bandHeight;
+
+        trans_ring_wait(line_seq[alt]);
+
+        uint16_t* dst = line[alt];
+        for (short j = 0; j < lineCount; ++j)
+        {
+            line_fn(dst, left, top + y + j, width, arg);
+            dst += width;
         }
-        trans[x].flags=SPI_TRANS_USE_TXDATA;
+
+        line_seq[alt] = send_buffer(line[alt], width * lineCount * 2);
+
+        ++alt;
+        if (alt > 1) alt = 0;
     }
 
+    trans_ring_wait_all();
+
+    ++stats.write_calls;
+    stats.write_us += esp_timer_get_time() - start;
+}
+
+void ili9341_write_frame_rectangle_bands(short left, short top, short width, short height, ili9341_band_fn band_fn, void* arg)
+{
+    short y;
+    int64_t start = esp_timer_get_time();
+
+    if (left < 0 || top < 0) abort();
+    if (width < 1 || height < 1) abort();
+    if (width > 320 || !band_fn) abort();
+
+    send_reset_drawing(left, top, width, height);
+
+    // Render a band into one buffer while the other one is on the wire.
+    const short bandHeight = (320 * LINE_COUNT) / width;
+
+    short alt = 0;
+    for (y = 0; y < height; y += bandHeight)
+    {
+        short lineCount = height - y;
+        if (lineCount > bandHeight) lineCount = bandHeight;
+
+        trans_ring_wait(line_seq[alt]);
+
+        band_fn(line[alt], left, top + y, width, lineCount, arg);
+
+        line_seq[alt] = send_buffer(line[alt], width * lineCount * 2);
+
+        ++alt;
+        if (alt > 1) alt = 0;
+    }
+
+    trans_ring_wait_all();
+
+    ++stats.write_calls;
+    stats.write_us += esp_timer_get_time() - start;
+}
+
+void ili9341_stats_get(ili9341_stats_t* out)
+{
+    *out = stats;
+}
+
+void ili9341_stats_reset()
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+void ili9341_init()
+{
     // Initialize SPI
     esp_err_t ret;
     //spi_device_handle_t spi;
@@ -453,6 +681,7 @@ void ili9341_init()
     buscfg.sclk_io_num = SPI_PIN_NUM_CLK;
     buscfg.quadwp_io_num=-1;
     buscfg.quadhd_io_num=-1;
+    buscfg.max_transfer_sz = SPI_MAX_TRANSFER;
 
     spi_device_interface_config_t devcfg;
 	memset(&devcfg, 0, sizeof(devcfg));
@@ -460,7 +689,7 @@ void ili9341_init()
     devcfg.clock_speed_hz = LCD_SPI_CLOCK_RATE;
     devcfg.mode = 0;                                //SPI mode 0
     devcfg.spics_io_num = LCD_PIN_NUM_CS;               //CS pin
-    devcfg.queue_size = 7;                          //We want to be able to queue 7 transactions at a time
+    devcfg.queue_size = TRANS_RING_SIZE;            //One queue entry per ring slot
     devcfg.pre_cb = ili_spi_pre_transfer_callback;  //Specify pre-transfer callback to handle D/C line
     devcfg.post_cb = ili_spi_post_transfer_callback;
     devcfg.flags = SPI_DEVICE_NO_DUMMY ;//SPI_DEVICE_HALFDUPLEX;
@@ -3,8 +3,42 @@
 void ili9341_init();
 void ili9341_write_frame(uint16_t* buffer);
 void ili9341_write_frame_rectangle(short left, short top, short width, short height, uint16_t* buffer);
+void ili9341_write_frame_rectangle_stride(short left, short top, short width, short height, short stride, uint16_t* buffer);
 void ili9341_write_frame_rectangleLE(short left, short top, short width, short height, uint16_t* buffer);
+void ili9341_write_frame_rectangleLE_stride(short left, short top, short width, short height, short stride, uint16_t* buffer);
 
+// Writes one row of a window: width pixels of row y starting at column left,
+// in panel byte order.
+typedef void (*ili9341_line_fn)(uint16_t* dst, short left, short y, short width, void* arg);
+
+// Like ili9341_write_frame_rectangle, but the pixels are produced row by row
+// straight into the DMA line buffers.
+void ili9341_write_frame_rectangle_lines(short left, short top, short width, short height, ili9341_line_fn line_fn, void* arg);
+
+// Writes a band of the window: height rows of width pixels starting at
+// (left, top), packed, in panel byte order.
+typedef void (*ili9341_band_fn)(uint16_t* dst, short left, short top, short width, short height, void* arg);
+
+// The same, a band of rows at a time
+void ili9341_write_frame_rectangle_bands(short left, short top, short width, short height, ili9341_band_fn band_fn, void* arg);
+
+// Fill a rectangle with one RGB565 color
+void ili9341_fill_rect(short left, short top, short width, short height, uint16_t color);
 void ili9341_clear(uint16_t color);
 
+// Transport counters, accumulated since ili9341_init or the last reset
+typedef struct
+{
+    uint32_t transactions;  // SPI transactions queued
+    uint32_t bytes;         // bytes sent, commands included
+    uint32_t wait_us;       // time blocked in spi_device_get_trans_result
+    uint32_t write_calls;   // ili9341_write_frame_rectangle* calls
+    uint32_t write_us;      // time spent in them
+    uint32_t fill_calls;    // ili9341_fill_rect and ili9341_clear calls
+    uint32_t fill_us;       // time spent in them
+} ili9341_stats_t;
+
+void ili9341_stats_get(ili9341_stats_t* out);
+void ili9341_stats_reset();
+
 void backlight_deinit();
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "rgb565.h"
+
+
+// Word access to pixel buffers that are declared as uint16_t
+typedef uint32_t __attribute__((__may_alias__)) rgb565_pair_t;
+
+
+static inline uint16_t swap_pixel(uint16_t pixel)
+{
+    return pixel << 8 | pixel >> 8;
+}
+
+// Swap both pixels of a word at once
+static inline uint32_t swap_pair(uint32_t pair)
+{
+    return ((pair & 0x00ff00ff) << 8) | ((pair >> 8) & 0x00ff00ff);
+}
+
+// Both the ESP32 and the host are little-endian: the first pixel of a pair
+// is in the low half of the word.
+void rgb565_swap_copy(uint16_t* dst, const uint16_t* src, size_t count)
+{
+    if (count == 0) return;
+
+    // Word align the destination
+    if ((uintptr_t)dst & 2)
+    {
+        *dst++ = swap_pixel(*src++);
+        --count;
+    }
+
+    rgb565_pair_t* d = (rgb565_pair_t*)dst;
+
+    // A source one pixel off word alignment is left to the scalar loop:
+    // carrying the odd pixel between loads measured slower than it.
+    if (((uintptr_t)src & 2) == 0)
+    {
+        // Both aligned: four pixels per iteration
+        const rgb565_pair_t* s = (const rgb565_pair_t*)src;
+
+        while (count >= 4)
+        {
+            uint32_t a = s[0];
+            uint32_t b = s[1];
+            d[0] = swap_pair(a);
+            d[1] = swap_pair(b);
+
+            s += 2;
+            d += 2;
+            count -= 4;
+        }
+
+        if (count >= 2)
+        {
+            *d++ = swap_pair(*s++);
+            count -= 2;
+        }
+
+        src = (const uint16_t*)s;
+    }
+
+    dst = (uint16_t*)d;
+    while (count--)
+    {
+        *dst++ = swap_pixel(*src++);
+    }
+}
+
+void rgb565_fill(uint16_t* dst, uint16_t color, size_t count)
+{
+    if (count == 0) return;
+
+    if ((uintptr_t)dst & 2)
+    {
+        *dst++ = color;
+        --count;
+    }
+
+    const uint32_t pair = color | ((uint32_t)color << 16);
+    rgb565_pair_t* d = (rgb565_pair_t*)dst;
+
+    while (count >= 8)
+    {
+        d[0] = pair;
+        d[1] = pair;
+        d[2] = pair;
+        d[3] = pair;
+
+        d += 4;
+        count -= 8;
+    }
+
+    while (count >= 2)
+    {
+        *d++ = pair;
+        count -= 2;
+    }
+
+    if (count)
+    {
+        *(uint16_t*)d = color;
+    }
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Copy count RGB565 pixels from src to dst, swapping the bytes of each one.
+// dst and src may be the same buffer.
+void rgb565_swap_copy(uint16_t* dst, const uint16_t* src, size_t count);
+
+// Set count pixels starting at dst to color, two pixels per store.
+void rgb565_fill(uint16_t* dst, uint16_t color, size_t count);
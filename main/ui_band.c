@@ -0,0 +1,327 @@
+#include "ui_fb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "odroid_display.h"
+
+#ifdef UI_BAND_RENDERER
+
+// The screen as a list of draw operations in painter's order. An opaque
+// operation drops the earlier ones it covers, so the list stays short.
+#define UI_OPS_MAX (96)
+
+typedef enum
+{
+    UI_OP_FILL = 0,
+    UI_OP_FRAME,
+    UI_OP_STRING,
+    UI_OP_TILE
+} ui_op_type_t;
+
+typedef struct
+{
+    ui_op_type_t type;
+    short x1, y1, x2, y2;           // as drawn
+    short left, top, right, bottom; // pixels touched, clipped to the screen
+    UG_COLOR fore_color;
+    UG_COLOR back_color;
+    const UG_FONT* font;
+    void* data;                     // string or tile pixels, owned
+} ui_op_t;
+
+static ui_op_t ui_ops[UI_OPS_MAX];
+static int ui_op_count = 0;
+
+// Style for the next ui_string, as set by the UI task
+static const UG_FONT* ui_style_font = NULL;
+static UG_COLOR ui_style_fore_color = C_WHITE;
+static UG_COLOR ui_style_back_color = C_BLACK;
+
+// Band being rendered by the display task, in panel byte order
+static uint16_t* ui_band;
+static short ui_band_left;
+static short ui_band_top;
+static short ui_band_right;
+static short ui_band_bottom;
+static short ui_band_width;
+
+// left, top, right and bottom are the pixels the operation touches, before
+// clipping. For most operations that is what they are drawn at.
+static void ui_op_push(ui_op_t* op, short left, short top, short right, short bottom, bool opaque)
+{
+    op->left = (left > 0) ? left : 0;
+    op->top = (top > 0) ? top : 0;
+    op->right = (right < 319) ? right : 319;
+    op->bottom = (bottom < 239) ? bottom : 239;
+
+    if (op->left > op->right || op->top > op->bottom)
+    {
+        free(op->data);
+        return;
+    }
+
+    xSemaphoreTake(display_mutex, portMAX_DELAY);
+
+    if (opaque)
+    {
+        int count = 0;
+        for (int i = 0; i < ui_op_count; ++i)
+        {
+            ui_op_t* other = &ui_ops[i];
+            if (other->left >= op->left && other->right <= op->right &&
+                other->top >= op->top && other->bottom <= op->bottom)
+            {
+                free(other->data);
+            }
+            else
+            {
+                ui_ops[count++] = *other;
+            }
+        }
+
+        ui_op_count = count;
+    }
+
+    if (ui_op_count >= UI_OPS_MAX)
+    {
+        printf("%s: too many operations.\n", __func__);
+        abort();
+    }
+
+    ui_ops[ui_op_count++] = *op;
+
+    xSemaphoreGive(display_mutex);
+
+    ui_damage_rect(op->left, op->top, op->right, op->bottom);
+}
+
+void ui_font(const UG_FONT* font)
+{
+    ui_style_font = font;
+}
+
+void ui_forecolor(UG_COLOR c)
+{
+    ui_style_fore_color = c;
+}
+
+void ui_backcolor(UG_COLOR c)
+{
+    ui_style_back_color = c;
+}
+
+void ui_fill(short x1, short y1, short x2, short y2, UG_COLOR c)
+{
+    ui_op_t op;
+    memset(&op, 0, sizeof(op));
+
+    op.type = UI_OP_FILL;
+    op.x1 = (x1 < x2) ? x1 : x2;
+    op.y1 = (y1 < y2) ? y1 : y2;
+    op.x2 = (x1 < x2) ? x2 : x1;
+    op.y2 = (y1 < y2) ? y2 : y1;
+    op.fore_color = c;
+
+    ui_op_push(&op, op.x1, op.y1, op.x2, op.y2, true);
+}
+
+void ui_frame(short x1, short y1, short x2, short y2, UG_COLOR c)
+{
+    ui_op_t op;
+    memset(&op, 0, sizeof(op));
+
+    op.type = UI_OP_FRAME;
+    op.x1 = (x1 < x2) ? x1 : x2;
+    op.y1 = (y1 < y2) ? y1 : y2;
+    op.x2 = (x1 < x2) ? x2 : x1;
+    op.y2 = (y1 < y2) ? y2 : y1;
+    op.fore_color = c;
+
+    ui_op_push(&op, op.x1, op.y1, op.x2, op.y2, false);
+}
+
+void ui_string(short x, short y, const char* text)
+{
+    if (!ui_style_font) return;
+
+    const UG_FONT* font = ui_style_font;
+
+    ui_op_t op;
+    memset(&op, 0, sizeof(op));
+
+    op.type = UI_OP_STRING;
+    op.x1 = x;
+    op.y1 = y;
+    op.fore_color = ui_style_fore_color;
+    op.back_color = ui_style_back_color;
+    op.font = font;
+
+    // Same advance as UG_PutString. Wrapped or multi-line text starts over
+    // at x, but the clip box is widened to anywhere below y.
+    short right = x;
+    bool wraps = false;
+    for (const char* c = text; *c; ++c)
+    {
+        if (*c == '\n') wraps = true;
+        if (*c < font->start_char || *c > font->end_char) continue;
+
+        short width = font->widths ? font->widths[*c - font->start_char] : font->char_width;
+        if (right + width > 320 - 1) wraps = true;
+
+        right += width + gui.char_h_space;
+    }
+
+    op.x2 = wraps ? 319 : right - 1;
+    op.y2 = wraps ? 239 : y + font->char_height - 1;
+
+    op.data = strdup(text);
+    if (!op.data) abort();
+
+    ui_op_push(&op, wraps ? 0 : op.x1, op.y1, op.x2, op.y2, false);
+}
+
+static void ui_tile(short x, short y, short width, short height, const uint16_t* data)
+{
+    ui_op_t op;
+    memset(&op, 0, sizeof(op));
+
+    op.type = UI_OP_TILE;
+    op.x1 = x;
+    op.y1 = y;
+    op.x2 = x + width - 1;
+    op.y2 = y + height - 1;
+
+    op.data = malloc(width * height * sizeof(uint16_t));
+    if (!op.data) abort();
+
+    ui_tile_copy(op.data, data, width * height);
+
+    ui_op_push(&op, op.x1, op.y1, op.x2, op.y2, true);
+}
+
+
+// uGUI draws into the current band on the display task
+void pset(UG_S16 x, UG_S16 y, UG_COLOR color)
+{
+    if (x < ui_band_left || x > ui_band_right || y < ui_band_top || y > ui_band_bottom) return;
+
+    ui_band[(y - ui_band_top) * ui_band_width + (x - ui_band_left)] = ui_color_to_panel(color);
+}
+
+UG_RESULT ui_fill_frame(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c)
+{
+    if (x1 < ui_band_left) x1 = ui_band_left;
+    if (y1 < ui_band_top) y1 = ui_band_top;
+    if (x2 > ui_band_right) x2 = ui_band_right;
+    if (y2 > ui_band_bottom) y2 = ui_band_bottom;
+    if (x1 > x2 || y1 > y2) return UG_RESULT_OK;
+
+    uint16_t color = ui_color_to_panel(c);
+
+    for (short y = y1; y <= y2; ++y)
+    {
+        rgb565_fill(ui_band + (y - ui_band_top) * ui_band_width + (x1 - ui_band_left), color, x2 - x1 + 1);
+    }
+
+    return UG_RESULT_OK;
+}
+
+// Blit drivers: swap is set when the source is byte swapped from UG_COLOR
+static void ui_band_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p, bool swap)
+{
+    short left = (x > ui_band_left) ? x : ui_band_left;
+    short right = (x + w - 1 < ui_band_right) ? x + w - 1 : ui_band_right;
+    short top = (y > ui_band_top) ? y : ui_band_top;
+    short bottom = (y + h - 1 < ui_band_bottom) ? y + h - 1 : ui_band_bottom;
+    if (left > right || top > bottom) return;
+
+#ifdef USE_COLOR_RGB565_BE
+    const bool panel_swap = swap;
+#else
+    const bool panel_swap = !swap;
+#endif
+
+    for (short row = top; row <= bottom; ++row)
+    {
+        const UG_COLOR* src = p + (row - y) * stride + (left - x);
+        uint16_t* dst = ui_band + (row - ui_band_top) * ui_band_width + (left - ui_band_left);
+
+        if (panel_swap)
+        {
+            rgb565_swap_copy(dst, src, right - left + 1);
+        }
+        else
+        {
+            memcpy(dst, src, (right - left + 1) * sizeof(uint16_t));
+        }
+    }
+}
+
+UG_RESULT ui_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p)
+{
+    ui_band_blit(x, y, w, h, stride, p, false);
+    return UG_RESULT_OK;
+}
+
+UG_RESULT ui_blit_swap(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p)
+{
+    ui_band_blit(x, y, w, h, stride, p, true);
+    return UG_RESULT_OK;
+}
+
+// Band producer for the display task: replays the operations that touch it
+static void ui_render_band(uint16_t* dst, short left, short top, short width, short height, void* arg)
+{
+    ui_band = dst;
+    ui_band_left = left;
+    ui_band_top = top;
+    ui_band_right = left + width - 1;
+    ui_band_bottom = top + height - 1;
+    ui_band_width = width;
+
+    // Nothing drawn yet is black, like a cleared framebuffer
+    memset(dst, 0, width * height * sizeof(uint16_t));
+
+    for (int i = 0; i < ui_op_count; ++i)
+    {
+        const ui_op_t* op = &ui_ops[i];
+        if (op->right < ui_band_left || op->left > ui_band_right ||
+            op->bottom < ui_band_top || op->top > ui_band_bottom) continue;
+
+        switch (op->type)
+        {
+            case UI_OP_FILL:
+                UG_FillFrame(op->x1, op->y1, op->x2, op->y2, op->fore_color);
+                break;
+
+            case UI_OP_FRAME:
+                UG_DrawFrame(op->x1, op->y1, op->x2, op->y2, op->fore_color);
+                break;
+
+            case UI_OP_STRING:
+                UG_FontSelect(op->font);
+                UG_SetForecolor(op->fore_color);
+                UG_SetBackcolor(op->back_color);
+                UG_PutString(op->x1, op->y1, (char*)op->data);
+                break;
+
+            case UI_OP_TILE:
+                UG_BlitRGB565(op->x1, op->y1, op->x2 - op->x1 + 1, op->y2 - op->y1 + 1,
+                    op->x2 - op->x1 + 1, (const UG_U16*)op->data);
+                break;
+        }
+    }
+}
+
+void ui_draw_image(short x, short y, short width, short height, const uint16_t* data)
+{
+    ui_tile(x, y, width, height, data);
+}
+
+void ui_flush_window(short left, short top, short width, short height)
+{
+    ili9341_write_frame_rectangle_bands(left, top, width, height, ui_render_band, NULL);
+}
+
+#endif
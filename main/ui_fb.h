@@ -0,0 +1,131 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rgb565.h"
+#include "../components/ugui/ugui.h"
+
+// The screen is kept as an RGB565 fb by default, drawn by ui_fb_rgb565.c.
+
+// Keep fb as 8 bit palette indices instead: 75KB instead of 150KB. Tiles are
+// kept in separate direct color overlays. Once 256 colors have been drawn,
+// new ones get the nearest palette entry. Drawn by ui_fb_indexed.c.
+//#define UI_FRAMEBUFFER_INDEXED
+
+// Or keep no framebuffer at all: the screen is a short list of draw
+// operations that the display task renders band by band into the DMA line
+// buffers. Takes precedence over UI_FRAMEBUFFER_INDEXED. Drawn by ui_band.c.
+//#define UI_BAND_RENDERER
+
+#if defined(UI_BAND_RENDERER)
+#undef UI_FRAMEBUFFER_INDEXED
+#elif defined(UI_FRAMEBUFFER_INDEXED)
+extern uint8_t fb[320 * 240];
+#else
+extern uint16_t fb[320 * 240];
+#endif
+
+// Firmware list rows on a page, each with a tile
+#define ITEM_COUNT (4)
+
+// The screen is split into square tiles; pset marks the tile it touches and
+// ui_update_display sends the marked tiles as a few address windows.
+#define DAMAGE_TILE_SIZE (16)
+#define DAMAGE_COLUMNS ((320 + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE)
+#define DAMAGE_ROWS ((240 + DAMAGE_TILE_SIZE - 1) / DAMAGE_TILE_SIZE)
+
+typedef struct
+{
+    uint8_t tiles[DAMAGE_ROWS][DAMAGE_COLUMNS];
+} ui_damage_map_t;
+
+// In main.c. damage is drawn into on the UI task; display_mutex is held by
+// the display task while it flushes.
+extern UG_GUI gui;
+extern ui_damage_map_t damage;
+extern SemaphoreHandle_t display_mutex;
+
+// Pixel coordinates, inclusive and clipped
+void ui_damage_rect(short x1, short y1, short x2, short y2);
+
+#if defined(UI_FRAMEBUFFER_INDEXED) || defined(UI_BAND_RENDERER)
+static inline uint16_t ui_color_to_panel(UG_COLOR c)
+{
+#ifdef USE_COLOR_RGB565_BE
+    return c;
+#else
+    return (c << 8) | (c >> 8);
+#endif
+}
+
+// Tiles are stored little-endian in .fw files: copy one as UG_COLORs
+static inline void ui_tile_copy(uint16_t* dst, const uint16_t* src, size_t count)
+{
+#ifdef USE_COLOR_RGB565_BE
+    rgb565_swap_copy(dst, src, count);
+#else
+    memcpy(dst, src, count * sizeof(uint16_t));
+#endif
+}
+#endif
+
+// uGUI drivers of the selected mode
+void pset(UG_S16 x, UG_S16 y, UG_COLOR color);
+UG_RESULT ui_fill_frame(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c);
+UG_RESULT ui_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p);
+UG_RESULT ui_blit_swap(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p);
+#ifndef UI_BAND_RENDERER
+void* ui_fill_area(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2);
+UG_RESULT ui_draw_line(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c);
+#endif
+
+// data is a tile as stored in .fw files: little-endian RGB565
+void ui_draw_image(short x, short y, short width, short height, const uint16_t* data);
+
+// Sends part of the screen to the panel. Runs on the display task.
+void ui_flush_window(short left, short top, short width, short height);
+
+// Drawing calls used by the UI. The band renderer records them instead.
+#ifdef UI_BAND_RENDERER
+void ui_font(const UG_FONT* font);
+void ui_forecolor(UG_COLOR c);
+void ui_backcolor(UG_COLOR c);
+void ui_fill(short x1, short y1, short x2, short y2, UG_COLOR c);
+void ui_frame(short x1, short y1, short x2, short y2, UG_COLOR c);
+void ui_string(short x, short y, const char* text);
+#else
+static inline void ui_font(const UG_FONT* font)
+{
+    UG_FontSelect(font);
+}
+
+static inline void ui_forecolor(UG_COLOR c)
+{
+    UG_SetForecolor(c);
+}
+
+static inline void ui_backcolor(UG_COLOR c)
+{
+    UG_SetBackcolor(c);
+}
+
+static inline void ui_fill(short x1, short y1, short x2, short y2, UG_COLOR c)
+{
+    UG_FillFrame(x1, y1, x2, y2, c);
+}
+
+static inline void ui_frame(short x1, short y1, short x2, short y2, UG_COLOR c)
+{
+    UG_DrawFrame(x1, y1, x2, y2, c);
+}
+
+static inline void ui_string(short x, short y, const char* text)
+{
+    UG_PutString(x, y, (char*)text);
+}
+#endif
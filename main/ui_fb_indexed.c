@@ -0,0 +1,502 @@
+#include "ui_fb.h"
+
+#include <stdlib.h>
+
+#include "odroid_display.h"
+
+#ifdef UI_FRAMEBUFFER_INDEXED
+
+uint8_t fb[320 * 240] __attribute__((aligned(4)));
+
+
+// Colors get a palette entry the first time they are drawn. Entries are
+// never removed, so the display task can expand indices at any time.
+static UG_COLOR ui_palette[256];
+static uint16_t ui_palette_panel[256]; // the same colors in panel byte order
+static int ui_palette_count = 0;
+// The last two colors looked up: text alternates between fore and back color
+static UG_COLOR ui_palette_last_color[2];
+static uint8_t ui_palette_last_index[2];
+
+// Squared distance between two colors, used once the palette is full
+static int ui_color_distance(UG_COLOR first, UG_COLOR second)
+{
+    uint16_t x = UG_RGB565(first);
+    uint16_t y = UG_RGB565(second);
+
+    int r = ((x >> 11) & 0x1f) - ((y >> 11) & 0x1f);
+    int g = ((x >> 5) & 0x3f) - ((y >> 5) & 0x3f);
+    int b = (x & 0x1f) - (y & 0x1f);
+
+    return (r * r * 4) + (g * g) + (b * b * 4);
+}
+
+static uint8_t ui_palette_index(UG_COLOR c)
+{
+    if (ui_palette_count > 0)
+    {
+        if (c == ui_palette_last_color[0]) return ui_palette_last_index[0];
+        if (c == ui_palette_last_color[1]) return ui_palette_last_index[1];
+    }
+
+    int index = -1;
+    for (int i = 0; i < ui_palette_count; ++i)
+    {
+        if (ui_palette[i] == c)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0)
+    {
+        if (ui_palette_count < 256)
+        {
+            index = ui_palette_count;
+            ui_palette_panel[index] = ui_color_to_panel(c);
+            ui_palette[index] = c;
+            ++ui_palette_count;
+
+            // Nothing cached yet: both entries start out as the first color
+            if (index == 0) ui_palette_last_color[0] = c;
+        }
+        else
+        {
+            int best = 0x7fffffff;
+            for (int i = 0; i < ui_palette_count; ++i)
+            {
+                int distance = ui_color_distance(ui_palette[i], c);
+                if (distance < best)
+                {
+                    best = distance;
+                    index = i;
+                }
+            }
+        }
+    }
+
+    ui_palette_last_color[1] = ui_palette_last_color[0];
+    ui_palette_last_index[1] = ui_palette_last_index[0];
+    ui_palette_last_color[0] = c;
+    ui_palette_last_index[0] = index;
+
+    return index;
+}
+
+// Direct color rectangles drawn over fb, one per tile on screen
+#define UI_OVERLAY_MAX (ITEM_COUNT + 1)
+
+typedef struct
+{
+    short left;
+    short top;
+    short right;
+    short bottom;
+    UG_COLOR* pixels;   // NULL when the slot is free
+} ui_overlay_t;
+
+static ui_overlay_t ui_overlays[UI_OVERLAY_MAX];
+static int ui_overlay_count = 0;
+
+static bool ui_overlay_add(short x, short y, short width, short height, const uint16_t* data)
+{
+    if (x < 0 || y < 0 || x + width > 320 || y + height > 240) return false;
+
+    for (int i = 0; i < UI_OVERLAY_MAX; ++i)
+    {
+        ui_overlay_t* overlay = &ui_overlays[i];
+        if (overlay->pixels) continue;
+
+        UG_COLOR* pixels = malloc(width * height * sizeof(UG_COLOR));
+        if (!pixels) return false;
+
+        ui_tile_copy(pixels, data, width * height);
+
+        xSemaphoreTake(display_mutex, portMAX_DELAY);
+        overlay->left = x;
+        overlay->top = y;
+        overlay->right = x + width - 1;
+        overlay->bottom = y + height - 1;
+        overlay->pixels = pixels;
+        ++ui_overlay_count;
+        xSemaphoreGive(display_mutex);
+
+        ui_damage_rect(overlay->left, overlay->top, overlay->right, overlay->bottom);
+        return true;
+    }
+
+    return false;
+}
+
+// Draw into the overlay under (x, y), if any
+static bool ui_overlay_pset(short x, short y, UG_COLOR c)
+{
+    for (int i = 0; i < UI_OVERLAY_MAX; ++i)
+    {
+        ui_overlay_t* overlay = &ui_overlays[i];
+        if (overlay->pixels &&
+            x >= overlay->left && x <= overlay->right &&
+            y >= overlay->top && y <= overlay->bottom)
+        {
+            short width = overlay->right - overlay->left + 1;
+            overlay->pixels[(y - overlay->top) * width + (x - overlay->left)] = c;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Drop the overlays inside the rectangle
+static void ui_overlay_remove(short x1, short y1, short x2, short y2)
+{
+    for (int i = 0; i < UI_OVERLAY_MAX; ++i)
+    {
+        ui_overlay_t* overlay = &ui_overlays[i];
+        if (!overlay->pixels) continue;
+
+        if (x1 <= overlay->left && x2 >= overlay->right &&
+            y1 <= overlay->top && y2 >= overlay->bottom)
+        {
+            xSemaphoreTake(display_mutex, portMAX_DELAY);
+            free(overlay->pixels);
+            overlay->pixels = NULL;
+            --ui_overlay_count;
+            xSemaphoreGive(display_mutex);
+        }
+    }
+}
+
+// A fill removes the overlays it covers and paints into the ones it overlaps
+static void ui_overlay_fill(short x1, short y1, short x2, short y2, UG_COLOR c)
+{
+    ui_overlay_remove(x1, y1, x2, y2);
+
+    for (int i = 0; i < UI_OVERLAY_MAX; ++i)
+    {
+        ui_overlay_t* overlay = &ui_overlays[i];
+        if (!overlay->pixels) continue;
+
+        if (x2 < overlay->left || x1 > overlay->right ||
+            y2 < overlay->top || y1 > overlay->bottom) continue;
+
+        short left = (x1 > overlay->left) ? x1 : overlay->left;
+        short right = (x2 < overlay->right) ? x2 : overlay->right;
+        short top = (y1 > overlay->top) ? y1 : overlay->top;
+        short bottom = (y2 < overlay->bottom) ? y2 : overlay->bottom;
+        short width = overlay->right - overlay->left + 1;
+
+        for (short y = top; y <= bottom; ++y)
+        {
+            UG_COLOR* dst = overlay->pixels + (y - overlay->top) * width - overlay->left;
+            for (short x = left; x <= right; ++x)
+            {
+                dst[x] = c;
+            }
+        }
+    }
+}
+
+// Line producer for the display task: expands palette indices, then copies
+// the overlays crossing row y on top.
+static void ui_expand_line(uint16_t* dst, short left, short y, short width, void* arg)
+{
+    const uint8_t* src = fb + y * 320 + left;
+    short right = left + width - 1;
+
+    for (short i = 0; i < width; ++i)
+    {
+        dst[i] = ui_palette_panel[src[i]];
+    }
+
+    if (ui_overlay_count == 0) return;
+
+    for (int i = 0; i < UI_OVERLAY_MAX; ++i)
+    {
+        const ui_overlay_t* overlay = &ui_overlays[i];
+        if (!overlay->pixels || y < overlay->top || y > overlay->bottom) continue;
+
+        short from = (left > overlay->left) ? left : overlay->left;
+        short to = (right < overlay->right) ? right : overlay->right;
+        if (from > to) continue;
+
+        const UG_COLOR* pixels = overlay->pixels +
+            (y - overlay->top) * (overlay->right - overlay->left + 1) + (from - overlay->left);
+
+#ifdef USE_COLOR_RGB565_BE
+        memcpy(dst + (from - left), pixels, (to - from + 1) * sizeof(uint16_t));
+#else
+        rgb565_swap_copy(dst + (from - left), pixels, to - from + 1);
+#endif
+    }
+}
+
+
+void pset(UG_S16 x, UG_S16 y, UG_COLOR color)
+{
+    if ((unsigned)x >= 320 || (unsigned)y >= 240) return;
+
+    if (ui_overlay_count == 0 || !ui_overlay_pset(x, y, color))
+    {
+        fb[y * 320 + x] = ui_palette_index(color);
+    }
+    damage.tiles[y / DAMAGE_TILE_SIZE][x / DAMAGE_TILE_SIZE] = 1;
+}
+
+// Fill driver for UG_FillFrame: writes whole rows of fb and marks the
+// covered tiles once instead of going through pset for every pixel.
+UG_RESULT ui_fill_frame(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c)
+{
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > 319) x2 = 319;
+    if (y2 > 239) y2 = 239;
+    if (x1 > x2 || y1 > y2) return UG_RESULT_OK;
+
+    uint8_t index = ui_palette_index(c);
+
+    if (x1 == x2)
+    {
+        // A column: one store per row
+        for (short y = y1; y <= y2; ++y)
+        {
+            fb[y * 320 + x1] = index;
+        }
+    }
+    else
+    {
+        for (short y = y1; y <= y2; ++y)
+        {
+            memset(fb + y * 320 + x1, index, x2 - x1 + 1);
+        }
+    }
+
+    if (ui_overlay_count > 0)
+    {
+        ui_overlay_fill(x1, y1, x2, y2, c);
+    }
+
+    ui_damage_rect(x1, y1, x2, y2);
+
+    return UG_RESULT_OK;
+}
+
+// True when the rectangle overlaps an overlay
+static bool ui_overlay_overlaps(short x1, short y1, short x2, short y2)
+{
+    for (int i = 0; i < UI_OVERLAY_MAX; ++i)
+    {
+        const ui_overlay_t* overlay = &ui_overlays[i];
+        if (overlay->pixels &&
+            x1 <= overlay->right && x2 >= overlay->left &&
+            y1 <= overlay->bottom && y2 >= overlay->top)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Line driver for UG_DrawLine, as in ui_fb_rgb565.c. Lines over an overlay
+// go through pset.
+UG_RESULT ui_draw_line(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c)
+{
+    if (x1 == x2 || y1 == y2)
+    {
+        return ui_fill_frame((x1 < x2) ? x1 : x2, (y1 < y2) ? y1 : y2,
+            (x1 < x2) ? x2 : x1, (y1 < y2) ? y2 : y1, c);
+    }
+
+    // Lines that leave the screen are clipped by uGUI's spans
+    if ((unsigned)x1 >= 320 || (unsigned)x2 >= 320 ||
+        (unsigned)y1 >= 240 || (unsigned)y2 >= 240)
+    {
+        return UG_RESULT_FAIL;
+    }
+
+    if (ui_overlay_count > 0 &&
+        ui_overlay_overlaps((x1 < x2) ? x1 : x2, (y1 < y2) ? y1 : y2,
+            (x1 < x2) ? x2 : x1, (y1 < y2) ? y2 : y1))
+    {
+        return UG_RESULT_FAIL;
+    }
+
+    uint8_t color = ui_palette_index(c);
+
+    short dxabs = (x2 > x1) ? x2 - x1 : x1 - x2;
+    short dyabs = (y2 > y1) ? y2 - y1 : y1 - y2;
+    short sgndx = (x2 > x1) ? 1 : -1;
+    short sgndy = (y2 > y1) ? 1 : -1;
+    short x = x1;
+    short y = y1;
+    uint8_t* dst = fb + y1 * 320 + x1;
+
+    if (dxabs >= dyabs)
+    {
+        short error = dxabs >> 1;
+        for (short n = 0; n <= dxabs; ++n)
+        {
+            *dst = color;
+            damage.tiles[y / DAMAGE_TILE_SIZE][x / DAMAGE_TILE_SIZE] = 1;
+
+            error += dyabs;
+            if (error >= dxabs)
+            {
+                error -= dxabs;
+                y += sgndy;
+                dst += sgndy * 320;
+            }
+            x += sgndx;
+            dst += sgndx;
+        }
+    }
+    else
+    {
+        short error = dyabs >> 1;
+        for (short n = 0; n <= dyabs; ++n)
+        {
+            *dst = color;
+            damage.tiles[y / DAMAGE_TILE_SIZE][x / DAMAGE_TILE_SIZE] = 1;
+
+            error += dxabs;
+            if (error >= dyabs)
+            {
+                error -= dyabs;
+                x += sgndx;
+                dst += sgndx;
+            }
+            y += sgndy;
+            dst += sgndy * 320;
+        }
+    }
+
+    return UG_RESULT_OK;
+}
+
+// Area driver for uGUI's character output. It returns a function that takes
+// the pixels of the area in row order and stores them straight into fb.
+static short ui_area_left;
+static short ui_area_right;
+static short ui_area_x;
+static short ui_area_y;
+
+static uint8_t* ui_area_dst;
+static short ui_area_width;
+static short ui_area_remaining;     // pixels left in the current row
+
+// The area is entirely on screen
+static void ui_area_push(UG_COLOR c)
+{
+    *ui_area_dst++ = ui_palette_index(c);
+
+    if (--ui_area_remaining == 0)
+    {
+        ui_area_remaining = ui_area_width;
+        ui_area_dst += 320 - ui_area_width;
+    }
+}
+
+// The area is partly off screen, or overlaps an overlay
+static void ui_area_push_pset(UG_COLOR c)
+{
+    pset(ui_area_x, ui_area_y, c);
+
+    if (++ui_area_x > ui_area_right)
+    {
+        ui_area_x = ui_area_left;
+        ++ui_area_y;
+    }
+}
+
+void* ui_fill_area(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2)
+{
+    // uGUI does not check the result, so always hand back a function
+    if (x1 < 0 || y1 < 0 || x2 > 319 || y2 > 239 ||
+        ui_overlay_overlaps(x1, y1, x2, y2))
+    {
+        ui_area_left = x1;
+        ui_area_right = x2;
+        ui_area_x = x1;
+        ui_area_y = y1;
+        return (void*)ui_area_push_pset;
+    }
+
+    ui_area_dst = fb + y1 * 320 + x1;
+    ui_area_width = x2 - x1 + 1;
+    ui_area_remaining = ui_area_width;
+
+    ui_damage_rect(x1, y1, x2, y2);
+
+    return (void*)ui_area_push;
+}
+
+// Blit drivers: store whole rows of palette indices into fb. swap is set
+// when the source is byte swapped from UG_COLOR.
+static UG_RESULT ui_fb_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p, bool swap)
+{
+    short left = (x > 0) ? x : 0;
+    short right = (x + w - 1 < 319) ? x + w - 1 : 319;
+    short top = (y > 0) ? y : 0;
+    short bottom = (y + h - 1 < 239) ? y + h - 1 : 239;
+    if (left > right || top > bottom) return UG_RESULT_OK;
+
+    // Let uGUI go through pset for the overlays
+    if (ui_overlay_overlaps(left, top, right, bottom)) return UG_RESULT_FAIL;
+
+    // Runs of the same color share a palette lookup
+    UG_COLOR last = p[(top - y) * stride + (left - x)];
+    uint8_t index = ui_palette_index(swap ? (UG_COLOR)((last << 8) | (last >> 8)) : last);
+
+    for (short row = top; row <= bottom; ++row)
+    {
+        const UG_COLOR* src = p + (row - y) * stride + (left - x);
+        uint8_t* dst = fb + row * 320 + left;
+
+        for (short i = 0; i <= right - left; ++i)
+        {
+            if (src[i] != last)
+            {
+                last = src[i];
+                index = ui_palette_index(swap ? (UG_COLOR)((last << 8) | (last >> 8)) : last);
+            }
+            dst[i] = index;
+        }
+    }
+
+    ui_damage_rect(left, top, right, bottom);
+
+    return UG_RESULT_OK;
+}
+
+UG_RESULT ui_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p)
+{
+    return ui_fb_blit(x, y, w, h, stride, p, false);
+}
+
+UG_RESULT ui_blit_swap(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p)
+{
+    return ui_fb_blit(x, y, w, h, stride, p, true);
+}
+
+// Tiles go into overlays, so they keep their colors
+void ui_draw_image(short x, short y, short width, short height, const uint16_t* data)
+{
+    ui_overlay_remove(x, y, x + width - 1, y + height - 1);
+
+    if (ui_overlay_add(x, y, width, height, data)) return;
+
+#ifdef USE_COLOR_RGB565_BE
+    UG_BlitRGB565Swap(x, y, width, height, width, data);
+#else
+    UG_BlitRGB565(x, y, width, height, width, data);
+#endif
+}
+
+void ui_flush_window(short left, short top, short width, short height)
+{
+    ili9341_write_frame_rectangle_lines(left, top, width, height, ui_expand_line, NULL);
+}
+
+#endif
@@ -0,0 +1,232 @@
+#include "ui_fb.h"
+
+#include "odroid_display.h"
+
+#if !defined(UI_BAND_RENDERER) && !defined(UI_FRAMEBUFFER_INDEXED)
+
+uint16_t fb[320 * 240] __attribute__((aligned(4)));
+
+
+void pset(UG_S16 x, UG_S16 y, UG_COLOR color)
+{
+    if ((unsigned)x >= 320 || (unsigned)y >= 240) return;
+
+    fb[y * 320 + x] = color;
+    damage.tiles[y / DAMAGE_TILE_SIZE][x / DAMAGE_TILE_SIZE] = 1;
+}
+
+// Fill driver for UG_FillFrame: writes whole rows of fb and marks the
+// covered tiles once instead of going through pset for every pixel.
+UG_RESULT ui_fill_frame(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c)
+{
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 > 319) x2 = 319;
+    if (y2 > 239) y2 = 239;
+    if (x1 > x2 || y1 > y2) return UG_RESULT_OK;
+
+    if (x1 == x2)
+    {
+        // A column: one store per row
+        for (short y = y1; y <= y2; ++y)
+        {
+            fb[y * 320 + x1] = c;
+        }
+    }
+    else
+    {
+        for (short y = y1; y <= y2; ++y)
+        {
+            rgb565_fill(fb + y * 320 + x1, c, x2 - x1 + 1);
+        }
+    }
+
+    ui_damage_rect(x1, y1, x2, y2);
+
+    return UG_RESULT_OK;
+}
+
+// Line driver for UG_DrawLine. Rows and columns are fills. Other lines are
+// mostly runs of one to three pixels, too short for the fill driver, so
+// they are stored straight into fb along the same path uGUI takes instead
+// of a pset call per pixel.
+UG_RESULT ui_draw_line(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2, UG_COLOR c)
+{
+    if (x1 == x2 || y1 == y2)
+    {
+        return ui_fill_frame((x1 < x2) ? x1 : x2, (y1 < y2) ? y1 : y2,
+            (x1 < x2) ? x2 : x1, (y1 < y2) ? y2 : y1, c);
+    }
+
+    // Lines that leave the screen are clipped by uGUI's spans
+    if ((unsigned)x1 >= 320 || (unsigned)x2 >= 320 ||
+        (unsigned)y1 >= 240 || (unsigned)y2 >= 240)
+    {
+        return UG_RESULT_FAIL;
+    }
+
+    short dxabs = (x2 > x1) ? x2 - x1 : x1 - x2;
+    short dyabs = (y2 > y1) ? y2 - y1 : y1 - y2;
+    short sgndx = (x2 > x1) ? 1 : -1;
+    short sgndy = (y2 > y1) ? 1 : -1;
+    short x = x1;
+    short y = y1;
+    uint16_t* dst = fb + y1 * 320 + x1;
+
+    if (dxabs >= dyabs)
+    {
+        short error = dxabs >> 1;
+        for (short n = 0; n <= dxabs; ++n)
+        {
+            *dst = c;
+            damage.tiles[y / DAMAGE_TILE_SIZE][x / DAMAGE_TILE_SIZE] = 1;
+
+            error += dyabs;
+            if (error >= dxabs)
+            {
+                error -= dxabs;
+                y += sgndy;
+                dst += sgndy * 320;
+            }
+            x += sgndx;
+            dst += sgndx;
+        }
+    }
+    else
+    {
+        short error = dyabs >> 1;
+        for (short n = 0; n <= dyabs; ++n)
+        {
+            *dst = c;
+            damage.tiles[y / DAMAGE_TILE_SIZE][x / DAMAGE_TILE_SIZE] = 1;
+
+            error += dxabs;
+            if (error >= dyabs)
+            {
+                error -= dyabs;
+                x += sgndx;
+                dst += sgndx;
+            }
+            y += sgndy;
+            dst += sgndy * 320;
+        }
+    }
+
+    return UG_RESULT_OK;
+}
+
+// Area driver for uGUI's character output. It returns a function that takes
+// the pixels of the area in row order and stores them straight into fb.
+static short ui_area_left;
+static short ui_area_right;
+static short ui_area_x;
+static short ui_area_y;
+
+static uint16_t* ui_area_dst;
+static short ui_area_width;
+static short ui_area_remaining;     // pixels left in the current row
+
+// The area is entirely on screen
+static void ui_area_push(UG_COLOR c)
+{
+    *ui_area_dst++ = c;
+
+    if (--ui_area_remaining == 0)
+    {
+        ui_area_remaining = ui_area_width;
+        ui_area_dst += 320 - ui_area_width;
+    }
+}
+
+// The area is partly off screen
+static void ui_area_push_pset(UG_COLOR c)
+{
+    pset(ui_area_x, ui_area_y, c);
+
+    if (++ui_area_x > ui_area_right)
+    {
+        ui_area_x = ui_area_left;
+        ++ui_area_y;
+    }
+}
+
+void* ui_fill_area(UG_S16 x1, UG_S16 y1, UG_S16 x2, UG_S16 y2)
+{
+    // uGUI does not check the result, so always hand back a function
+    if (x1 < 0 || y1 < 0 || x2 > 319 || y2 > 239)
+    {
+        ui_area_left = x1;
+        ui_area_right = x2;
+        ui_area_x = x1;
+        ui_area_y = y1;
+        return (void*)ui_area_push_pset;
+    }
+
+    ui_area_dst = fb + y1 * 320 + x1;
+    ui_area_width = x2 - x1 + 1;
+    ui_area_remaining = ui_area_width;
+
+    ui_damage_rect(x1, y1, x2, y2);
+
+    return (void*)ui_area_push;
+}
+
+// Blit drivers: copy whole rows into fb. swap is set when the source is
+// byte swapped from UG_COLOR.
+static UG_RESULT ui_fb_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p, bool swap)
+{
+    short left = (x > 0) ? x : 0;
+    short right = (x + w - 1 < 319) ? x + w - 1 : 319;
+    short top = (y > 0) ? y : 0;
+    short bottom = (y + h - 1 < 239) ? y + h - 1 : 239;
+    if (left > right || top > bottom) return UG_RESULT_OK;
+
+    for (short row = top; row <= bottom; ++row)
+    {
+        const UG_COLOR* src = p + (row - y) * stride + (left - x);
+        uint16_t* dst = fb + row * 320 + left;
+
+        if (swap)
+        {
+            rgb565_swap_copy(dst, src, right - left + 1);
+        }
+        else
+        {
+            memcpy(dst, src, (right - left + 1) * sizeof(uint16_t));
+        }
+    }
+
+    ui_damage_rect(left, top, right, bottom);
+
+    return UG_RESULT_OK;
+}
+
+UG_RESULT ui_blit(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p)
+{
+    return ui_fb_blit(x, y, w, h, stride, p, false);
+}
+
+UG_RESULT ui_blit_swap(UG_S16 x, UG_S16 y, UG_S16 w, UG_S16 h, UG_S16 stride, const UG_COLOR* p)
+{
+    return ui_fb_blit(x, y, w, h, stride, p, true);
+}
+
+void ui_draw_image(short x, short y, short width, short height, const uint16_t* data)
+{
+#ifdef USE_COLOR_RGB565_BE
+    UG_BlitRGB565Swap(x, y, width, height, width, data);
+#else
+    UG_BlitRGB565(x, y, width, height, width, data);
+#endif
+}
+
+void ui_flush_window(short left, short top, short width, short height)
+{
+#ifdef USE_COLOR_RGB565_BE
+    ili9341_write_frame_rectangle_stride(left, top, width, height, 320, fb + top * 320 + left);
+#else
+    ili9341_write_frame_rectangleLE_stride(left, top, width, height, 320, fb + top * 320 + left);
+#endif
+}
+
+#endif
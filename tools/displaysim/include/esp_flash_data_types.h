@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+#define CONFIG_PARTITION_TABLE_OFFSET 0x8000
+#define ESP_PARTITION_MAGIC 0x50AA
+
+#define PART_SUBTYPE_TEST 0x20
+
+typedef struct
+{
+    uint32_t offset;
+    uint32_t size;
+} esp_partition_pos_t;
+
+typedef struct
+{
+    uint16_t magic;
+    uint8_t type;
+    uint8_t subtype;
+    esp_partition_pos_t pos;
+    uint8_t label[16];
+    uint32_t flags;
+} esp_partition_info_t;
@@ -0,0 +1,5 @@
+#pragma once
+
+#include "esp_partition.h"
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
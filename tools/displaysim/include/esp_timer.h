@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdint.h>
+
+// Simulated time: only advances while waiting on the SPI bus
+int64_t esp_timer_get_time();
@@ -0,0 +1,28 @@
+#pragma once
+
+// Host stand-ins for the FreeRTOS API used by main/. Nothing is scheduled:
+// created tasks never run and blocking calls return at once.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "esp_err.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE (0)
+#define pdTRUE (1)
+#define pdPASS (1)
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portTICK_RATE_MS (1)
+#define portTICK_PERIOD_MS (1)
+#define portYIELD_FROM_ISR()
+
+#define IRAM_ATTR
+#define DRAM_ATTR
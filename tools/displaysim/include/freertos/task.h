@@ -0,0 +1,21 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+typedef void* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+// Calls sim_yield, which stands in for whatever the other tasks would do
+void vTaskDelay(TickType_t ticks);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack,
+    void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+
+void vTaskDelete(TaskHandle_t task);
+
+// Every task runs at the same priority
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+
+#define taskYIELD() sim_yield()
+
+void sim_yield();
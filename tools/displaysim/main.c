@@ -0,0 +1,158 @@
+// Runs the UI code from main/main.c against the simulated bus and panel and
+// reports the bus time and transactions per frame.
+
+#define app_main firmware_app_main
+#include "../../main/main.c"
+
+#include <unistd.h>
+
+#include "sim.h"
+
+
+// display_task never runs on the host: flush whatever it would have picked up
+void sim_yield()
+{
+    if (!display_queue) return;
+
+    while (xQueueReceive(display_queue, &display_flush, 0) == pdTRUE)
+    {
+        ui_flush(&display_flush);
+    }
+}
+
+
+static const char* ppm_prefix = NULL;
+
+static int64_t bench_start_time;
+static sim_bus_stats_t bench_start_bus;
+
+static void bench_begin()
+{
+    sim_yield();
+    sim_advance(0);
+
+    bench_start_time = esp_timer_get_time();
+    sim_bus_stats_get(&bench_start_bus);
+}
+
+// Wait for the panel to catch up, then report the frames drawn since
+// bench_begin.
+static void bench_end(const char* name, int frames)
+{
+    sim_yield();
+
+    int64_t elapsed = esp_timer_get_time() - bench_start_time;
+
+    sim_bus_stats_t bus;
+    sim_bus_stats_get(&bus);
+
+    printf("%-10s frames=%-4d %8.3f ms/frame %8.1f transactions/frame %9.1f bytes/frame %8.1f pixels/frame\n",
+        name, frames,
+        elapsed / 1000.0 / frames,
+        (bus.transactions - bench_start_bus.transactions) / (double)frames,
+        (bus.bytes - bench_start_bus.bytes) / (double)frames,
+        (bus.pixels - bench_start_bus.pixels) / (double)frames);
+
+    if (ppm_prefix)
+    {
+        sprintf(tempstring, "%s%s.ppm", ppm_prefix, name);
+        if (sim_panel_write_ppm(tempstring) != 0)
+        {
+            printf("%s: could not write '%s'\n", __func__, tempstring);
+        }
+    }
+}
+
+
+static char* DEFAULT_FILES[] =
+{
+    "Alpha.fw", "Bravo.fw", "Charlie.fw", "Delta.fw", "Echo.fw",
+    "Foxtrot.fw", "Golf.fw", "Hotel.fw", "India.fw", "Juliett.fw"
+};
+
+int main(int argc, char* argv[])
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "c:t:d:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': sim_spi_set_clock(atoi(optarg)); break;
+            case 't': sim_spi_set_overhead(atoi(optarg)); break;
+            case 'd': path = optarg; break;
+            case 'o': ppm_prefix = optarg; break;
+            default:
+                printf("usage: %s [-c spi_hz] [-t transaction_overhead_ns] [-d firmware_dir] [-o ppm_prefix]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    VERSION = "Ver: displaysim";
+
+    ili9341_init();
+
+    bench_begin();
+    ili9341_clear(0xffff);
+    bench_end("clear", 1);
+
+    ui_init();
+
+    char** names;
+    int count = odroid_sdcard_files_get(path, ".fw", &names);
+    if (count < 1)
+    {
+        odroid_sdcard_files_free(names, count);
+
+        names = DEFAULT_FILES;
+        count = sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]);
+    }
+
+    // Menu: first page, moving the selection, then the next page
+    bench_begin();
+    ui_draw_page(names, count, 0);
+    bench_end("page", 1);
+
+    bench_begin();
+    for (int i = 1; i < ITEM_COUNT && i < count; ++i)
+    {
+        ui_draw_page(names, count, i);
+        sim_yield();
+    }
+    bench_end("select", (count < ITEM_COUNT ? count : ITEM_COUNT) - 1);
+
+    bench_begin();
+    ui_draw_page(names, count, count > ITEM_COUNT ? ITEM_COUNT : 0);
+    bench_end("next", 1);
+
+    // A name too long for one row wraps back to the x it was drawn at
+    char* wrap_names[] = { "A_really_long_firmware_name_that_wraps_around.fw", "Short.fw" };
+
+    bench_begin();
+    ui_draw_title();
+    ui_draw_page(wrap_names, 2, 0);
+    bench_end("wrap", 1);
+
+    // Install screen, then the progress updates of a 1MB partition
+    bench_begin();
+    ui_draw_title();
+    DisplayHeader(FirmwareDescription);
+    DisplayMessage("Verifying ...");
+    bench_end("install", 1);
+
+    const int length = 1024 * 1024;
+    const int ERASE_BLOCK_SIZE = 4096;
+    int frames = 0;
+
+    bench_begin();
+    for (int offset = 0; offset < length; offset += ERASE_BLOCK_SIZE)
+    {
+        sprintf(tempstring, "Writing (%d)", 0);
+        DisplayProgress((float)offset / (float)(length - ERASE_BLOCK_SIZE) * 100.0f);
+        DisplayMessage(tempstring);
+        sim_yield();
+        ++frames;
+    }
+    bench_end("progress", frames);
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+// Simulated SPI bus and ILI9341 panel behind the driver/spi_master.h mock.
+//
+// Transactions are queued in order and each one takes the per-transaction
+// overhead plus its bits at the bus clock. A transaction reaches the panel
+// (and its post callback runs) only once simulated time has passed its end,
+// so a buffer that is rewritten too early shows up as corrupt pixels. The
+// CPU is infinitely fast: simulated time only moves while the driver waits
+// for a result or a task delays.
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t commands;      // transactions sent with D/C low
+    uint32_t bytes;
+    uint32_t pixels;        // pixels written into GRAM
+    int64_t busy_us;        // time the bus spent transferring
+} sim_bus_stats_t;
+
+// Bus clock in Hz. 0 (the default) uses the clock the device was added with.
+void sim_spi_set_clock(int hz);
+
+// Fixed cost of each transaction in ns: queueing, the ISR and D/C setup
+void sim_spi_set_overhead(int ns);
+
+void sim_bus_stats_get(sim_bus_stats_t* out);
+
+// Move simulated time forward, completing whatever finishes meanwhile
+void sim_advance(int64_t us);
+
+uint16_t sim_panel_get_pixel(int x, int y);
+
+// Write the panel contents as a binary PPM. Returns 0 on success.
+int sim_panel_write_ppm(const char* filename);
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "nvs_flash.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "rom/crc.h"
+
+#include "odroid_sdcard.h"
+#include "input.h"
+
+#include "sim.h"
+
+// Everything main/ needs from ESP-IDF and from the board, minus the display.
+
+
+// FreeRTOS
+struct sim_queue
+{
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t* items;
+};
+
+struct sim_semaphore
+{
+    int taken;
+};
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim_yield();
+    sim_advance((int64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name, uint32_t stack,
+    void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core)
+{
+    // Tasks never run; sim_yield does their work when the caller delays
+    if (handle) *handle = NULL;
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task)
+{
+    return 1;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+    struct sim_queue* queue = calloc(1, sizeof(struct sim_queue));
+    if (!queue) abort();
+
+    queue->length = length;
+    queue->itemSize = itemSize;
+    queue->items = malloc(length * itemSize);
+    if (!queue->items) abort();
+
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait)
+{
+    if (queue->count >= queue->length) return pdFALSE;
+
+    UBaseType_t index = (queue->head + queue->count) % queue->length;
+    memcpy(queue->items + index * queue->itemSize, item, queue->itemSize);
+    ++queue->count;
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t queue, const void* item)
+{
+    if (queue->length != 1) abort();
+
+    memcpy(queue->items, item, queue->itemSize);
+    queue->count = 1;
+
+    return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait)
+{
+    if (queue->count == 0) return pdFALSE;
+
+    memcpy(item, queue->items + queue->head * queue->itemSize, queue->itemSize);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait)
+{
+    if (xQueuePeek(queue, item, wait) != pdTRUE) return pdFALSE;
+
+    queue->head = (queue->head + 1) % queue->length;
+    --queue->count;
+
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    return queue->count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    free(queue->items);
+    free(queue);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    struct sim_semaphore* semaphore = calloc(1, sizeof(struct sim_semaphore));
+    if (!semaphore) abort();
+
+    return semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t wait)
+{
+    if (semaphore->taken) return pdFALSE;
+
+    semaphore->taken = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->taken = 0;
+    return pdTRUE;
+}
+
+
+// System
+uint32_t esp_get_free_heap_size()
+{
+    return 0;
+}
+
+void* heap_caps_malloc(size_t size, uint32_t caps)
+{
+    return malloc(size);
+}
+
+void esp_restart()
+{
+    exit(0);
+}
+
+esp_err_t nvs_flash_init()
+{
+    return ESP_OK;
+}
+
+
+// GPIO and backlight
+static uint32_t gpio_levels[GPIO_NUM_MAX];
+
+esp_err_t gpio_set_direction(gpio_num_t gpio, gpio_mode_t mode)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level)
+{
+    if (gpio < 0 || gpio >= GPIO_NUM_MAX) return ESP_FAIL;
+
+    gpio_levels[gpio] = level;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio)
+{
+    if (gpio < 0 || gpio >= GPIO_NUM_MAX) return 0;
+
+    return gpio_levels[gpio];
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t* config) { return ESP_OK; }
+esp_err_t ledc_channel_config(const ledc_channel_config_t* config) { return ESP_OK; }
+esp_err_t ledc_fade_func_install(int flags) { return ESP_OK; }
+void ledc_fade_func_uninstall() { }
+esp_err_t ledc_set_fade_with_time(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty, int ms) { return ESP_OK; }
+esp_err_t ledc_fade_start(ledc_mode_t mode, ledc_channel_t channel, ledc_fade_mode_t wait) { return ESP_OK; }
+esp_err_t ledc_stop(ledc_mode_t mode, ledc_channel_t channel, uint32_t idle) { return ESP_OK; }
+
+
+// Flash and partitions
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char* label)
+{
+    return NULL;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) { return ESP_FAIL; }
+esp_err_t spi_flash_read(size_t address, void* data, size_t size) { return ESP_FAIL; }
+esp_err_t spi_flash_write(size_t address, const void* data, size_t size) { return ESP_FAIL; }
+esp_err_t spi_flash_erase_range(size_t address, size_t size) { return ESP_FAIL; }
+esp_err_t spi_flash_erase_sector(size_t sector) { return ESP_FAIL; }
+void esp_partition_reload_table() { }
+
+uint32_t crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len)
+{
+    crc = ~crc;
+
+    for (uint32_t i = 0; i < len; ++i)
+    {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+
+// SD card: the path is a host directory
+esp_err_t odroid_sdcard_open()
+{
+    return ESP_OK;
+}
+
+esp_err_t odroid_sdcard_close()
+{
+    return ESP_OK;
+}
+
+static int sim_files_compare(const void* a, const void* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+int odroid_sdcard_files_get(const char* path, const char* extension, char*** filesOut)
+{
+    const int MAX_FILES = 1024;
+    int count = 0;
+
+    char** result = (char**)malloc(MAX_FILES * sizeof(char*));
+    if (!result) abort();
+
+    DIR* dir = opendir(path);
+    if (dir)
+    {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL && count < MAX_FILES)
+        {
+            size_t length = strlen(entry->d_name);
+            size_t extensionLength = strlen(extension);
+
+            if (length > extensionLength &&
+                strcasecmp(entry->d_name + length - extensionLength, extension) == 0)
+            {
+                result[count++] = strdup(entry->d_name);
+            }
+        }
+
+        closedir(dir);
+    }
+
+    qsort(result, count, sizeof(char*), sim_files_compare);
+
+    *filesOut = result;
+    return count;
+}
+
+void odroid_sdcard_files_free(char** files, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        free(files[i]);
+    }
+
+    free(files);
+}
+
+
+// Input: nothing is ever pressed
+void input_init()
+{
+}
+
+void input_read(odroid_gamepad_state* out_state)
+{
+    memset(out_state, 0, sizeof(*out_state));
+}
@@ -0,0 +1,322 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/spi_master.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+
+#include "sim.h"
+
+// D/C pin used by main/odroid_display.c
+#define SIM_PIN_NUM_DC (GPIO_NUM_21)
+
+#define SIM_QUEUE_MAX (16)
+
+#define PANEL_WIDTH (320)
+#define PANEL_HEIGHT (240)
+
+struct spi_device_t
+{
+    spi_device_interface_config_t config;
+
+    spi_transaction_t* queue[SIM_QUEUE_MAX];
+    int64_t queue_end[SIM_QUEUE_MAX];   // ns
+    int queue_count;
+    int queue_done;                     // completed, result not fetched
+};
+
+static struct spi_device_t device;
+static bool device_added = false;
+
+static int bus_clock = 0;
+static int bus_overhead = 10000;        // ns
+static int64_t now = 0;                 // ns
+static int64_t bus_free = 0;            // ns
+static sim_bus_stats_t bus_stats;
+
+
+// ILI9341 model: column/page address windows and memory writes, in the
+// coordinates the driver uses after MADCTL (landscape, 320x240).
+static uint16_t gram[PANEL_HEIGHT][PANEL_WIDTH];
+
+static uint8_t panel_cmd;
+static uint8_t panel_params[4];
+static int panel_param_count;
+static int panel_column_start, panel_column_end = PANEL_WIDTH - 1;
+static int panel_page_start, panel_page_end = PANEL_HEIGHT - 1;
+static int panel_x, panel_y;
+static int panel_byte = -1;             // first byte of a pixel, or -1
+
+
+static void panel_write_pixel(uint16_t pixel)
+{
+    if (panel_x < PANEL_WIDTH && panel_y < PANEL_HEIGHT)
+    {
+        gram[panel_y][panel_x] = pixel;
+    }
+
+    ++bus_stats.pixels;
+
+    if (++panel_x > panel_column_end)
+    {
+        panel_x = panel_column_start;
+        if (++panel_y > panel_page_end) panel_y = panel_page_start;
+    }
+}
+
+static void panel_command(uint8_t cmd)
+{
+    panel_cmd = cmd;
+    panel_param_count = 0;
+    panel_byte = -1;
+
+    switch (cmd)
+    {
+        case 0x2C:  // Memory Write
+            panel_x = panel_column_start;
+            panel_y = panel_page_start;
+            break;
+
+        default:    // 0x3C (Write Memory Continue) keeps the position
+            break;
+    }
+}
+
+static void panel_data(const uint8_t* data, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        switch (panel_cmd)
+        {
+            case 0x2A:  // Column Address Set
+            case 0x2B:  // Page Address Set
+                if (panel_param_count < 4)
+                {
+                    panel_params[panel_param_count++] = data[i];
+                }
+
+                if (panel_param_count == 4)
+                {
+                    int start = (panel_params[0] << 8) | panel_params[1];
+                    int end = (panel_params[2] << 8) | panel_params[3];
+
+                    if (panel_cmd == 0x2A)
+                    {
+                        panel_column_start = start;
+                        panel_column_end = end;
+                    }
+                    else
+                    {
+                        panel_page_start = start;
+                        panel_page_end = end;
+                    }
+                }
+                break;
+
+            case 0x2C:
+            case 0x3C:
+                if (panel_byte < 0)
+                {
+                    panel_byte = data[i];
+                }
+                else
+                {
+                    panel_write_pixel((panel_byte << 8) | data[i]);
+                    panel_byte = -1;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+
+// Deliver the oldest queued transaction to the panel
+static void bus_complete(spi_transaction_t* t)
+{
+    const uint8_t* data = (t->flags & SPI_TRANS_USE_TXDATA) ? t->tx_data : t->tx_buffer;
+    size_t length = t->length / 8;
+
+    if (device.config.pre_cb) device.config.pre_cb(t);
+
+    if (gpio_get_level(SIM_PIN_NUM_DC))
+    {
+        panel_data(data, length);
+    }
+    else
+    {
+        ++bus_stats.commands;
+        if (length > 0) panel_command(data[0]);
+        if (length > 1) panel_data(data + 1, length - 1);
+    }
+
+    if (device.config.post_cb) device.config.post_cb(t);
+}
+
+static void bus_update()
+{
+    while (device.queue_done < device.queue_count &&
+        device.queue_end[device.queue_done] <= now)
+    {
+        bus_complete(device.queue[device.queue_done]);
+        ++device.queue_done;
+    }
+}
+
+static void bus_wait_until(int64_t time)
+{
+    if (time > now) now = time;
+    bus_update();
+}
+
+void sim_advance(int64_t us)
+{
+    bus_wait_until(now + us * 1000);
+}
+
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t* config, int dma_chan)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t* config, spi_device_handle_t* handle)
+{
+    if (device_added || config->queue_size > SIM_QUEUE_MAX) return ESP_FAIL;
+
+    memset(&device, 0, sizeof(device));
+    device.config = *config;
+    device_added = true;
+
+    *handle = &device;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_queue_trans(spi_device_handle_t handle, spi_transaction_t* trans, TickType_t wait)
+{
+    if (handle->queue_count - handle->queue_done >= handle->config.queue_size)
+    {
+        // The real call would block until the bus frees an entry
+        bus_wait_until(handle->queue_end[handle->queue_done]);
+    }
+
+    if (handle->queue_count >= SIM_QUEUE_MAX)
+    {
+        // Results were never fetched
+        return ESP_FAIL;
+    }
+
+    int clock = bus_clock ? bus_clock : handle->config.clock_speed_hz;
+    int64_t start = (bus_free > now) ? bus_free : now;
+    int64_t duration = bus_overhead + (int64_t)trans->length * 1000000000LL / clock;
+
+    bus_free = start + duration;
+
+    handle->queue[handle->queue_count] = trans;
+    handle->queue_end[handle->queue_count] = bus_free;
+    ++handle->queue_count;
+
+    ++bus_stats.transactions;
+    bus_stats.bytes += trans->length / 8;
+    bus_stats.busy_us += duration / 1000;
+
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t handle, spi_transaction_t** trans, TickType_t wait)
+{
+    if (handle->queue_count == 0)
+    {
+        if (wait != 0)
+        {
+            printf("%s: nothing queued, would block forever\n", __func__);
+            abort();
+        }
+
+        return -1;
+    }
+
+    if (handle->queue_done == 0)
+    {
+        if (wait == 0) return -1;
+
+        bus_wait_until(handle->queue_end[0]);
+    }
+
+    *trans = handle->queue[0];
+
+    --handle->queue_count;
+    --handle->queue_done;
+    memmove(&handle->queue[0], &handle->queue[1], handle->queue_count * sizeof(handle->queue[0]));
+    memmove(&handle->queue_end[0], &handle->queue_end[1], handle->queue_count * sizeof(handle->queue_end[0]));
+
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t handle, spi_transaction_t* trans)
+{
+    spi_transaction_t* result;
+
+    esp_err_t ret = spi_device_queue_trans(handle, trans, portMAX_DELAY);
+    if (ret != ESP_OK) return ret;
+
+    return spi_device_get_trans_result(handle, &result, portMAX_DELAY);
+}
+
+
+int64_t esp_timer_get_time()
+{
+    return now / 1000;
+}
+
+void sim_spi_set_clock(int hz)
+{
+    bus_clock = hz;
+}
+
+void sim_spi_set_overhead(int ns)
+{
+    bus_overhead = ns;
+}
+
+void sim_bus_stats_get(sim_bus_stats_t* out)
+{
+    *out = bus_stats;
+}
+
+uint16_t sim_panel_get_pixel(int x, int y)
+{
+    return gram[y][x];
+}
+
+int sim_panel_write_ppm(const char* filename)
+{
+    FILE* file = fopen(filename, "wb");
+    if (!file) return -1;
+
+    fprintf(file, "P6\n%d %d\n255\n", PANEL_WIDTH, PANEL_HEIGHT);
+
+    for (int y = 0; y < PANEL_HEIGHT; ++y)
+    {
+        for (int x = 0; x < PANEL_WIDTH; ++x)
+        {
+            uint16_t pixel = gram[y][x];
+            uint8_t r = (pixel >> 11) & 0x1f;
+            uint8_t g = (pixel >> 5) & 0x3f;
+            uint8_t b = pixel & 0x1f;
+
+            uint8_t rgb[3];
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+
+            fwrite(rgb, 1, 3, file);
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
@@ -2,12 +2,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 extern unsigned long crc32(unsigned long crc, const unsigned char* buf, unsigned int len);
 
 
 const char* FIRMWARE = "firmware.fw";
-const char* HEADER = "ODROIDGO_FIRMWARE_V00_01";
+const char* HEADER_V00_01 = "ODROIDGO_FIRMWARE_V00_01";
+const char* HEADER_V00_02 = "ODROIDGO_FIRMWARE_V00_02";
 
 #define FIRMWARE_DESCRIPTION_SIZE (40)
 char FirmwareDescription[FIRMWARE_DESCRIPTION_SIZE];
@@ -27,6 +29,19 @@ typedef struct
     uint32_t length;
 } odroid_partition_t;
 
+// V00_02: after the tile, a table of the partitions and the CRC32 of their
+// data, then the CRC32 of the file up to there
+typedef struct
+{
+    odroid_partition_t slot;
+    uint32_t length;
+    uint32_t crc;
+} odroid_partition_hash_t;
+
+#define PARTS_MAX (20)
+odroid_partition_hash_t hashes[PARTS_MAX];
+void* part_data[PARTS_MAX];
+
 
 // ffmpeg -i tile.png -f rawvideo -pix_fmt rgb565 tile.raw
 uint8_t tile[86 * 48 * 2];
@@ -34,9 +49,15 @@ uint8_t tile[86 * 48 * 2];
 
 int main(int argc, char *argv[])
 {
-    if (argc < 4)
+    // -2 writes V00_02, which only an updated menu can install
+    int first = 1;
+    bool hashed = (argc > 1 && strcmp(argv[1], "-2") == 0);
+    if (hashed) ++first;
+
+    if (argc - first < 3)
     {
-        printf("usage: %s description tile type subtype length label binary [...]\n", argv[0]);
+        printf("usage: %s [-2] description tile type subtype length label binary [...]\n", argv[0]);
+        printf("  -2: write ODROIDGO_FIRMWARE_V00_02, with a table of partition CRC32s\n");
     }
     else
     {
@@ -44,18 +65,22 @@ int main(int argc, char *argv[])
         if (!file) abort();
 
         size_t count;
+        uint32_t checksum = 0;  // of the table and what comes before it
 
+        const char* HEADER = hashed ? HEADER_V00_02 : HEADER_V00_01;
         count = fwrite(HEADER, strlen(HEADER), 1, file);
+        checksum = crc32(checksum, (const unsigned char*)HEADER, strlen(HEADER));
         printf("HEADER='%s'\n", HEADER);
 
 
-        strncpy(FirmwareDescription, argv[1], FIRMWARE_DESCRIPTION_SIZE);
+        strncpy(FirmwareDescription, argv[first], FIRMWARE_DESCRIPTION_SIZE);
         FirmwareDescription[FIRMWARE_DESCRIPTION_SIZE - 1] = 0;
 
         count = fwrite(FirmwareDescription, FIRMWARE_DESCRIPTION_SIZE, 1, file);
+        checksum = crc32(checksum, (const unsigned char*)FirmwareDescription, FIRMWARE_DESCRIPTION_SIZE);
         printf("FirmwareDescription='%s'\n", FirmwareDescription);
 
-        FILE* tileFile = fopen(argv[2], "rb");
+        FILE* tileFile = fopen(argv[first + 1], "rb");
         if (!tileFile)
         {
             printf("tile file not found.\n");
@@ -70,12 +95,20 @@ int main(int argc, char *argv[])
         }
 
         count = fwrite(tile, 1, sizeof(tile), file);
+        checksum = crc32(checksum, tile, sizeof(tile));
         printf("tile: wrote %d bytes.\n", (int)count);
 
+        // read the partitions, so the table can go first
         int part_count = 0;
-        int i = 3;
+        int i = first + 2;
         while (i < argc)
         {
+            if (part_count >= PARTS_MAX)
+            {
+                printf("too many partitions.\n");
+                abort();
+            }
+
             odroid_partition_t part = {0};
 
 
@@ -112,18 +145,39 @@ int main(int argc, char *argv[])
 
             fclose(binary);
 
-            // write the entry
-            fwrite(&part, sizeof(part), 1, file);
+            odroid_partition_hash_t* hash = &hashes[part_count];
+            hash->slot = part;
+            hash->length = (uint32_t)fileSize;
+            hash->crc = crc32(0, data, fileSize);
+            part_data[part_count] = data;
 
-            uint32_t length = (uint32_t)fileSize;
-            fwrite(&length, sizeof(length), 1, file);
+            printf("part=%d, length=%d, crc=%#010x, data=%s\n", part_count, hash->length, hash->crc, filename);
 
-            fwrite(data, fileSize, 1, file);
-            free(data);
+            part_count++;
+        }
 
-            printf("part=%d, length=%d, data=%s\n", part_count, length, filename);
+        // write the table
+        if (hashed)
+        {
+            uint32_t table_count = (uint32_t)part_count;
+            fwrite(&table_count, sizeof(table_count), 1, file);
+            checksum = crc32(checksum, (const unsigned char*)&table_count, sizeof(table_count));
 
-            part_count++;
+            fwrite(hashes, sizeof(odroid_partition_hash_t), part_count, file);
+            checksum = crc32(checksum, (const unsigned char*)hashes, sizeof(odroid_partition_hash_t) * part_count);
+
+            fwrite(&checksum, sizeof(checksum), 1, file);
+            printf("table: count=%d, checksum=%#010x\n", part_count, checksum);
+        }
+
+        // write the entries
+        for (i = 0; i < part_count; ++i)
+        {
+            fwrite(&hashes[i].slot, sizeof(odroid_partition_t), 1, file);
+            fwrite(&hashes[i].length, sizeof(uint32_t), 1, file);
+
+            fwrite(part_data[i], hashes[i].length, 1, file);
+            free(part_data[i]);
         }
 
         fclose(file);
@@ -141,7 +195,7 @@ int main(int argc, char *argv[])
         void* data = malloc(BLOCK_SIZE);
         if (!data) abort();
 
-        uint32_t checksum = 0;
+        checksum = 0;
         for(int i = 0; i < (file_size); i += BLOCK_SIZE)
         {
             count = fread(data, 1, BLOCK_SIZE, file);
@@ -0,0 +1,458 @@
+// Times uGUI drawing into the framebuffer of main/main.c with the fill
+// drivers registered by ui_init, and again with uGUI falling back to pset
+// for every pixel.
+//
+// Built against the displaysim mocks with -fno-tree-vectorize so the host
+// behaves roughly like the Xtensa core.
+
+#define app_main firmware_app_main
+#include "../../main/main.c"
+
+#include <time.h>
+
+#define ITERATIONS (2000)
+#define ROUNDS (5)
+
+
+// Nothing is sent to the display here
+void sim_yield()
+{
+    if (!display_queue) return;
+
+    while (xQueueReceive(display_queue, &display_flush, 0) == pdTRUE)
+    {
+    }
+}
+
+#ifdef UI_BAND_RENDERER
+int main(int argc, char* argv[])
+{
+    printf("UI_BAND_RENDERER is defined: uGUI only draws during ui_flush.\n");
+    return 0;
+}
+#else
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_screen(int i)
+{
+    UG_FillFrame(0, 0, 319, 239, (i & 1) ? C_WHITE : C_BLACK);
+}
+
+// A list row highlight
+static void fill_strip(int i)
+{
+    short top = 32 + (i % ITEM_COUNT) * 16;
+    UG_FillFrame(0, top, 319, top + 15, (i & 1) ? C_BLUE : C_WHITE);
+}
+
+// The bar of DisplayProgress
+static void fill_bar(int i)
+{
+    UG_FillFrame(60, 130, 60 + (i % 200), 142, C_GREEN);
+}
+
+// A line of list text
+static void put_string(int i)
+{
+    UG_FontSelect(&FONT_8X12);
+    UG_SetForecolor((i & 1) ? C_BLACK : C_WHITE);
+    UG_SetBackcolor((i & 1) ? C_WHITE : C_BLUE);
+    UG_PutString(8, 36, "Super Mario Bros. Deluxe (USA).fw");
+}
+
+// The same line with every glyph expanded again
+static void put_string_uncached(int i)
+{
+    UG_GlyphCacheClear();
+    put_string(i);
+}
+
+// An anti-aliased 16x16 font with made up coverage. No 8 bpp font ships
+// with uGUI, and at this size the glyphs are too large for the cache.
+#define AA_SIZE (16)
+#define AA_FIRST (0x20)
+#define AA_LAST (0x7e)
+
+static unsigned char aa_data[(AA_LAST - AA_FIRST + 1) * AA_SIZE * AA_SIZE];
+static const UG_FONT aa_font = { aa_data, FONT_TYPE_8BPP, AA_SIZE, AA_SIZE, AA_FIRST, AA_LAST, NULL };
+
+static void aa_init()
+{
+    for (int c = 0; c <= AA_LAST - AA_FIRST; ++c)
+    {
+        for (int i = 0; i < AA_SIZE * AA_SIZE; ++i)
+        {
+            aa_data[c * AA_SIZE * AA_SIZE + i] = (i + c) & 0xff;
+        }
+    }
+}
+
+// A firmware description in the anti-aliased font
+static void put_string_aa(int i)
+{
+    UG_FontSelect(&aa_font);
+    UG_SetForecolor((i & 1) ? C_YELLOW : C_WHITE);
+    UG_SetBackcolor(C_BLUE);
+    UG_PutString(8, 60, "Homebrew NES");
+}
+
+#if !defined(UI_FRAMEBUFFER_INDEXED) && !defined(UI_BAND_RENDERER)
+// Every coverage level has to land within one step of the exact blend. The
+// indexed framebuffer would run out of palette entries for all the pairs.
+static void check_blend(UG_COLOR fore, UG_COLOR back)
+{
+    UG_FontSelect(&aa_font);
+    UG_SetForecolor(fore);
+    UG_SetBackcolor(back);
+    UG_PutChar(AA_FIRST, 0, 0, fore, back);
+
+    uint16_t f = UG_RGB565(fore);
+    uint16_t b = UG_RGB565(back);
+
+    for (int i = 0; i < AA_SIZE * AA_SIZE; ++i)
+    {
+        uint16_t c = UG_RGB565(fb[(i / AA_SIZE) * 320 + (i % AA_SIZE)]);
+        int a = aa_data[i];
+
+        const int shift[3] = { 11, 5, 0 };
+        const int mask[3] = { 0x1f, 0x3f, 0x1f };
+        for (int ch = 0; ch < 3; ++ch)
+        {
+            int fc = (f >> shift[ch]) & mask[ch];
+            int bc = (b >> shift[ch]) & mask[ch];
+            double exact = (fc * a + bc * (255 - a)) / 255.0;
+            int actual = (c >> shift[ch]) & mask[ch];
+
+            // 32 levels: up to 8 coverage steps apart
+            if (actual < exact - (mask[ch] / 31.0 + 0.5) || actual > exact + (mask[ch] / 31.0 + 0.5))
+            {
+                printf("blend mismatch: fore=%04x back=%04x coverage=%d channel=%d exact=%.2f actual=%d\n",
+                    f, b, a, ch, exact, actual);
+                abort();
+            }
+        }
+    }
+}
+
+// The exact 5-6-5 blend the table stands in for, one pixel at a time
+static UG_COLOR exact_blend(UG_COLOR fc, UG_COLOR bc, UG_U8 a)
+{
+    uint16_t f = UG_RGB565(fc);
+    uint16_t b = UG_RGB565(bc);
+
+    uint16_t r = ((f >> 11) * a + (b >> 11) * (255 - a) + 127) / 255;
+    uint16_t g = (((f >> 5) & 0x3f) * a + ((b >> 5) & 0x3f) * (255 - a) + 127) / 255;
+    uint16_t bl = ((f & 0x1f) * a + (b & 0x1f) * (255 - a) + 127) / 255;
+    return UG_RGB565((r << 11) | (g << 5) | bl);
+}
+#endif
+
+#ifndef UI_FRAMEBUFFER_INDEXED
+// A .fw tile, converted from file byte order as it is drawn
+static uint16_t tile[TILE_WIDTH * TILE_HEIGHT];
+
+static void blit_tile(int i)
+{
+    UG_BlitRGB565Swap(8 + (i % 4) * 2, 40, TILE_WIDTH, TILE_HEIGHT, TILE_WIDTH, tile);
+}
+#endif
+
+// The border of DisplayProgress
+static void draw_frame(int i)
+{
+    UG_DrawFrame(59, 129, 261, 143, (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_line_h(int i)
+{
+    UG_DrawLine(10, 100 + (i % 8), 309, 100 + (i % 8), (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_line_v(int i)
+{
+    UG_DrawLine(100 + (i % 8), 20, 100 + (i % 8), 219, (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_line_shallow(int i)
+{
+    UG_DrawLine(10, 200 - (i % 8), 309, 100 + (i % 8), (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_line_steep(int i)
+{
+    UG_DrawLine(150 - (i % 8), 20, 100 + (i % 8), 219, (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_circle(int i)
+{
+    UG_DrawCircle(160 + (i % 4), 120, 50, (i & 1) ? C_BLACK : C_RED);
+}
+
+static void fill_circle(int i)
+{
+    UG_FillCircle(160 + (i % 4), 120, 40, (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_round_frame(int i)
+{
+    UG_DrawRoundFrame(60 + (i % 4), 70, 259, 169, 8, (i & 1) ? C_BLACK : C_RED);
+}
+
+static void draw_mesh(int i)
+{
+    UG_DrawMesh(60 + (i % 2), 70, 159, 169, (i & 1) ? C_BLACK : C_RED);
+}
+
+// The line of put_string rendered once into a surface per color pair, the
+// way the list caches its labels. Text wraps before the last column, so it
+// takes a column more than the text.
+#define LABEL_WIDTH (33 * 9)
+#define LABEL_HEIGHT (12)
+
+static uint16_t label_pixels[2][LABEL_WIDTH * LABEL_HEIGHT];
+static UG_SURFACE labels[2];
+static UG_GUI label_gui;
+
+static void label_init()
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        labels[i].p = label_pixels[i];
+        labels[i].width = LABEL_WIDTH;
+        labels[i].height = LABEL_HEIGHT;
+        labels[i].stride = LABEL_WIDTH;
+        labels[i].format = SURFACE_FORMAT_COLOR;
+
+        if (i == 0) UG_SurfaceInit(&label_gui, &labels[i]);
+        UG_SurfaceSet(&label_gui, &labels[i]);
+        UG_SelectGUI(&label_gui);
+
+        UG_FontSelect(&FONT_8X12);
+        UG_SetForecolor((i & 1) ? C_BLACK : C_WHITE);
+        UG_SetBackcolor((i & 1) ? C_WHITE : C_BLUE);
+        UG_FillFrame(0, 0, LABEL_WIDTH - 1, LABEL_HEIGHT - 1, (i & 1) ? C_WHITE : C_BLUE);
+        UG_PutString(0, 0, "Super Mario Bros. Deluxe (USA).fw");
+    }
+
+    UG_SelectGUI(&gui);
+}
+
+static void blit_label(int i)
+{
+    UG_SurfaceBlit(&labels[i & 1], 0, 0, LABEL_WIDTH, LABEL_HEIGHT, 8, 36);
+}
+
+typedef struct
+{
+    const char* name;
+    void (*draw)(int i);
+    int pixels;
+} bench_case_t;
+
+static const bench_case_t CASES[] =
+{
+    { "screen 320x240", fill_screen, 320 * 240 },
+    { "strip 320x16", fill_strip, 320 * 16 },
+    { "bar 100x13", fill_bar, 100 * 13 },
+    { "text 33 chars", put_string, 33 * 8 * 12 },
+    { "text uncached", put_string_uncached, 33 * 8 * 12 },
+    { "aa text 16x16", put_string_aa, 12 * AA_SIZE * AA_SIZE },
+    { "label composite", blit_label, LABEL_WIDTH * LABEL_HEIGHT },
+    { "frame 203x15", draw_frame, 2 * 203 + 2 * 13 },
+    { "line h 300", draw_line_h, 300 },
+    { "line v 200", draw_line_v, 200 },
+    { "line 300x100", draw_line_shallow, 300 },
+    { "line 50x200", draw_line_steep, 200 },
+    { "circle r50", draw_circle, 283 },         // about 4 * sqrt(2) * r
+    { "fill circle r40", fill_circle, 5027 },   // about pi * r * r
+    { "round frame r8", draw_round_frame, 2 * 184 + 2 * 84 + 50 },
+    { "mesh 100x100", draw_mesh, 50 * 50 },    // no driver path: no pixels touch
+#ifndef UI_FRAMEBUFFER_INDEXED
+    // The indexed framebuffer keeps tiles in overlays instead
+    { "tile 86x48", blit_tile, TILE_WIDTH * TILE_HEIGHT },
+#endif
+};
+
+static void set_drivers(bool enabled)
+{
+    if (enabled)
+    {
+        UG_DriverEnable(DRIVER_DRAW_LINE);
+        UG_DriverEnable(DRIVER_FILL_FRAME);
+        UG_DriverEnable(DRIVER_FILL_AREA);
+        UG_DriverEnable(DRIVER_BLIT);
+        UG_DriverEnable(DRIVER_BLIT_SWAP);
+    }
+    else
+    {
+        UG_DriverDisable(DRIVER_DRAW_LINE);
+        UG_DriverDisable(DRIVER_FILL_FRAME);
+        UG_DriverDisable(DRIVER_FILL_AREA);
+        UG_DriverDisable(DRIVER_BLIT);
+        UG_DriverDisable(DRIVER_BLIT_SWAP);
+    }
+}
+
+static double run(const bench_case_t* bench, bool drivers)
+{
+    set_drivers(drivers);
+
+    double start = now();
+
+    for (int i = 0; i < ITERATIONS; ++i)
+    {
+        bench->draw(i);
+    }
+
+    return (now() - start) / ITERATIONS * 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+    ili9341_init();
+    ui_init();
+    aa_init();
+    label_init();
+
+#ifndef UI_FRAMEBUFFER_INDEXED
+    for (int i = 0; i < TILE_WIDTH * TILE_HEIGHT; ++i)
+    {
+        tile[i] = (i * 0x0821) & 0xffff;
+    }
+#endif
+
+    // Both paths have to leave the same pixels behind
+    static uint8_t expected[sizeof(fb)];
+    for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); ++c)
+    {
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            set_drivers(pass == 1);
+
+            memset(fb, 0, sizeof(fb));
+            for (int i = 0; i < 16; ++i)
+            {
+                CASES[c].draw(i);
+            }
+
+            if (pass == 0)
+            {
+                memcpy(expected, fb, sizeof(fb));
+            }
+            else if (memcmp(expected, fb, sizeof(fb)) != 0)
+            {
+                printf("mismatch: %s\n", CASES[c].name);
+                abort();
+            }
+        }
+    }
+
+#ifdef UI_FRAMEBUFFER_INDEXED
+    printf("framebuffer: 8 bit indexed\n");
+#else
+    printf("framebuffer: RGB565\n");
+#endif
+    printf("The drivers draw the same pixels as pset.\n");
+
+    // A composited label has to match the text drawn over its background
+    static uint8_t direct[sizeof(fb)];
+    for (int i = 0; i < 2; ++i)
+    {
+        memset(fb, 0, sizeof(fb));
+        UG_FillFrame(8, 36, 8 + LABEL_WIDTH - 1, 36 + LABEL_HEIGHT - 1, (i & 1) ? C_WHITE : C_BLUE);
+        put_string(i);
+        memcpy(direct, fb, sizeof(fb));
+
+        memset(fb, 0, sizeof(fb));
+        blit_label(i);
+        if (memcmp(direct, fb, sizeof(fb)) != 0)
+        {
+            printf("mismatch: label composite\n");
+            abort();
+        }
+    }
+    printf("Composited labels match the text drawn directly.\n");
+
+#ifndef UI_FRAMEBUFFER_INDEXED
+    const UG_COLOR colors[] = { C_BLACK, C_WHITE, C_BLUE, C_YELLOW, C_RED, C_GREEN, C_MAGENTA, C_DARK_GRAY };
+    const int color_count = sizeof(colors) / sizeof(colors[0]);
+    for (int f = 0; f < color_count; ++f)
+    {
+        for (int b = 0; b < color_count; ++b)
+        {
+            for (int pass = 0; pass < 2; ++pass)
+            {
+                set_drivers(pass == 1);
+                check_blend(colors[f], colors[b]);
+            }
+        }
+    }
+    printf("8 bpp blending is within one step of the exact 5-6-5 blend.\n");
+
+    {
+        const int count = 1 << 22;
+        double exact_ns = 0;
+        double put_ns = 0;
+
+        UG_FontSelect(&aa_font);
+        for (int round = 0; round < ROUNDS; ++round)
+        {
+            // The exact blend drawing the same glyph straight into the
+            // framebuffer, without any of UG_PutChar's work
+            double start = now();
+            for (int n = 0; n < count / (AA_SIZE * AA_SIZE); ++n)
+            {
+                for (int i = 0; i < AA_SIZE * AA_SIZE; ++i)
+                {
+                    fb[(i / AA_SIZE) * 320 + (i % AA_SIZE)] = exact_blend(C_YELLOW, C_BLUE, aa_data[i]);
+                }
+            }
+            double ns = (now() - start) / count * 1e9;
+            if (round == 0 || ns < exact_ns) exact_ns = ns;
+
+            start = now();
+            for (int n = 0; n < count / (AA_SIZE * AA_SIZE); ++n)
+            {
+                UG_PutChar(AA_FIRST, 0, 0, C_YELLOW, C_BLUE);
+            }
+            ns = (now() - start) / count * 1e9;
+            if (round == 0 || ns < put_ns) put_ns = ns;
+        }
+
+        printf("Exact 5-6-5 blend: %.2f ns/pixel, 8 bpp UG_PutChar with the blend table: %.2f ns/pixel\n",
+            exact_ns, put_ns);
+    }
+#endif
+    printf("\n");
+
+    printf("%-16s %12s %12s %10s %8s\n", "case", "pset us", "driver us", "driver MP/s", "speedup");
+
+    for (size_t c = 0; c < sizeof(CASES) / sizeof(CASES[0]); ++c)
+    {
+        const bench_case_t* bench = &CASES[c];
+
+        // Best of a few alternating runs, so that a case both paths draw
+        // the same way, like the mesh, reads as 1.00x
+        double slow = 0;
+        double fast = 0;
+        for (int round = 0; round < ROUNDS; ++round)
+        {
+            double t = run(bench, false);
+            if (round == 0 || t < slow) slow = t;
+
+            t = run(bench, true);
+            if (round == 0 || t < fast) fast = t;
+        }
+
+        printf("%-16s %12.2f %12.2f %10.1f %7.2fx\n", bench->name,
+            slow, fast, bench->pixels / fast, slow / fast);
+    }
+
+    return 0;
+}
+#endif